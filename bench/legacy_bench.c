@@ -0,0 +1,149 @@
+// Microbenchmark for the version 1 header parser. Builds a header in memory
+// and compares the strtok/sscanf tokenizer tarsau shipped with (given the
+// whole line at once, which it never was past 1000 bytes) against
+// legacyParse fed the header in one piece and in small reads.
+//
+// Usage: legacy_bench [entries] [piece_size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../legacy.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The tokenizer of the original reader, kept here as the baseline. It
+// modifies line, so it is given a copy.
+static unsigned long long parseTokens(char *line, unsigned long long *count) {
+    unsigned long long total = 0;
+    char *token = strtok(line, "|");
+    while (token != NULL) {
+        char filePath[512];
+        char permissions[10];
+        unsigned long long fileSize;
+        if (sscanf(token, "%511[^,],%9[^,],%llu", filePath, permissions, &fileSize) == 3) {
+            total += fileSize + strtol(permissions, NULL, 8) + strlen(filePath);
+            (*count)++;
+        }
+        token = strtok(NULL, "|");
+    }
+    return total;
+}
+
+typedef struct {
+    unsigned long long total;
+    unsigned long long count;
+} Totals;
+
+static int addEntry(void *context, const char *name, size_t nameLength, uint32_t mode, uint64_t size) {
+    Totals *totals = context;
+    (void)name;
+    totals->total += size + mode + nameLength;
+    totals->count++;
+    return 0;
+}
+
+static int parsePieces(const char *header, size_t length, size_t pieceSize, Totals *totals) {
+    LegacyParser parser;
+    legacyParserInit(&parser);
+    for (size_t offset = 0; offset < length && !parser.done; offset += pieceSize) {
+        size_t piece = length - offset < pieceSize ? length - offset : pieceSize;
+        if (legacyParse(&parser, header + offset, piece, addEntry, totals) == -1) {
+            return -1;
+        }
+    }
+    return parser.done ? 0 : -1;
+}
+
+static void report(const char *name, double seconds, size_t length, unsigned long long entries) {
+    printf("%-20s %8.3f s %10.1f MB/s %8.1f ns/entry\n", name, seconds, length / seconds / (1024 * 1024),
+           seconds * 1e9 / entries);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+    size_t pieceSize = argc > 2 ? strtoul(argv[2], NULL, 10) : 4096;
+    if (entries == 0 || pieceSize == 0) {
+        fprintf(stderr, "Usage: legacy_bench [entries] [piece_size]\n");
+        return EXIT_FAILURE;
+    }
+
+    // Paths of a typical source tree; the escaped form is only parsed by
+    // legacyParse, the baseline gets the same names without separators
+    char *header = NULL;
+    size_t length = 0;
+    FILE *file = open_memstream(&header, &length);
+    fprintf(file, "Size: %010llu", entries * 4096);
+    for (unsigned long long i = 0; i < entries; i++) {
+        char name[128];
+        snprintf(name, sizeof(name), "src/module%03llu/sub dir/file_%llu.c", i % 997, i);
+        fprintf(file, "|%s,644,%llu", name, 1024 + i % 8192);
+    }
+    fprintf(file, "\n");
+    fclose(file);
+
+    char *escaped = NULL;
+    size_t escapedLength = 0;
+    file = open_memstream(&escaped, &escapedLength);
+    fprintf(file, "Size: %010llu", entries * 4096);
+    for (unsigned long long i = 0; i < entries; i++) {
+        char name[128];
+        int nameLength = snprintf(name, sizeof(name), "src/m,%03llu/a|b/file_%llu.c", i % 997, i);
+        fputc('|', file);
+        legacyWriteName(file, name, nameLength);
+        fprintf(file, ",644,%llu", 1024 + i % 8192);
+    }
+    fprintf(file, "\n");
+    fclose(file);
+
+    printf("%llu entries, %.1f MB header, %zu-byte pieces\n", entries, length / (1024.0 * 1024), pieceSize);
+
+    char *copy = malloc(length + 1);
+    if (!copy) {
+        perror("Memory allocation error");
+        return EXIT_FAILURE;
+    }
+    memcpy(copy, header, length + 1);  // Fault the copy in first
+    double start = now();
+    memcpy(copy, header, length + 1);
+    report("memcpy", now() - start, length, entries);
+
+    unsigned long long count = 0;
+    start = now();
+    memcpy(copy, header, length + 1);
+    unsigned long long baseline = parseTokens(copy, &count);
+    report("strtok + sscanf", now() - start, length, entries);
+
+    Totals whole = {0, 0};
+    start = now();
+    int result = parsePieces(header, length, length, &whole);
+    report("legacyParse whole", now() - start, length, entries);
+
+    Totals pieces = {0, 0};
+    start = now();
+    result |= parsePieces(header, length, pieceSize, &pieces);
+    report("legacyParse pieces", now() - start, length, entries);
+
+    Totals names = {0, 0};
+    start = now();
+    result |= parsePieces(escaped, escapedLength, pieceSize, &names);
+    report("legacyParse escaped", now() - start, escapedLength, entries);
+
+    if (result != 0 || count != entries || whole.count != entries || pieces.count != entries ||
+        names.count != entries || whole.total != baseline || pieces.total != baseline) {
+        fprintf(stderr, "Parsers disagree (%llu %llu %llu %llu entries)\n", count, whole.count, pieces.count,
+                names.count);
+        return EXIT_FAILURE;
+    }
+
+    free(copy);
+    free(header);
+    free(escaped);
+    return EXIT_SUCCESS;
+}
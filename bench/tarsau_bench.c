@@ -0,0 +1,398 @@
+// End-to-end throughput benchmark for tarsau. Generates synthetic corpora,
+// runs -b and -a on each one and prints one JSON object per run:
+//
+//   {"corpus":"tiny","op":"build","status":0,"files":100000,"bytes":...,
+//    "seconds":...,"mb_per_s":...,"files_per_s":...,"user_s":...,
+//    "sys_s":...,"max_rss_kb":...,"syscalls":...,"io_uring":false}
+//
+// The corpora are deterministic, so numbers from two runs on the same
+// machine can be compared directly:
+//
+//   tiny   many small text files (default 100000 files of 1 to 512 bytes)
+//   large  a few big text files (default 3 files of 2048 MB)
+//   mixed  sizes spread from bytes to megabytes, plus a few binary files
+//          that the build must reject, in a two-level directory tree that
+//          is passed to -b as a single directory
+//
+// Timings, CPU time and peak RSS come from wait4. Syscalls are counted in a
+// second, ptrace-traced run of the same command, so the tracing overhead
+// does not show up in the timings; -x skips that run. -U runs tarsau with
+// --io-uring, and the JSON objects say which I/O path was asked for.
+//
+// Usage: tarsau_bench [-j threads] [-n tiny_files] [-L large_files]
+//                     [-S large_MB] [-m mixed_files] [-w workdir] [-x] [-U]
+//                     path_to_tarsau
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <ftw.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+#define NAME_SIZE 32
+#define TREE_FANOUT 8
+
+typedef struct {
+    const char *name;
+    char **files;
+    int numFiles;
+    uint64_t bytes;  // Total size of the files the build should accept
+    bool tree;       // Archived by walking "." instead of listing the files
+} Corpus;
+
+typedef struct {
+    int status;  // Exit status, or 128 + signal number
+    double seconds;
+    double userSeconds;
+    double systemSeconds;
+    long maxRssKb;
+    long syscalls;  // -1 when not counted
+} RunResult;
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t nextRandom(void) {
+    // xorshift64*
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return randomState * 0x2545f4914f6cdd1dULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills buffer with lowercase words and newlines
+static void fillText(char *buffer, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        uint64_t r = nextRandom();
+        size_t wordLength = 2 + (r & 7);
+        for (size_t j = 0; j < wordLength && i < length; j++, r >>= 5) {
+            buffer[i++] = 'a' + (r & 31) % 26;
+        }
+        if (i < length) {
+            buffer[i++] = (r & 15) == 0 ? '\n' : ' ';
+        }
+    }
+}
+
+static void writeCorpusFile(const char *path, uint64_t size, bool binary) {
+    static char buffer[WRITE_BUFFER_SIZE];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror("Error creating corpus file");
+        exit(EXIT_FAILURE);
+    }
+    while (size > 0) {
+        size_t length = size < sizeof(buffer) ? size : sizeof(buffer);
+        fillText(buffer, length);
+        if (binary) {
+            buffer[length / 2] = '\0';
+        }
+        if (write(fd, buffer, length) != (ssize_t)length) {
+            perror("Error writing corpus file");
+            exit(EXIT_FAILURE);
+        }
+        size -= length;
+    }
+    close(fd);
+}
+
+static void addCorpusFile(Corpus *corpus, int index, uint64_t size, bool binary) {
+    char *name = malloc(NAME_SIZE);
+    if (!name) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    if (corpus->tree) {
+        // d<i % 8>/d<i / 8 % 8>/<i>
+        snprintf(name, NAME_SIZE, "d%d", index % TREE_FANOUT);
+        mkdir(name, 0755);
+        snprintf(name, NAME_SIZE, "d%d/d%d", index % TREE_FANOUT, index / TREE_FANOUT % TREE_FANOUT);
+        mkdir(name, 0755);
+        snprintf(name, NAME_SIZE, "d%d/d%d/%d", index % TREE_FANOUT, index / TREE_FANOUT % TREE_FANOUT, index);
+    } else {
+        snprintf(name, NAME_SIZE, "%d", index);
+    }
+    writeCorpusFile(name, size, binary);
+    corpus->files[corpus->numFiles++] = name;
+    if (!binary) {
+        corpus->bytes += size;
+    }
+}
+
+// Creates workdir/name and fills it; the caller's working directory ends
+// up inside the corpus directory
+static void createCorpus(Corpus *corpus, const char *name, int numFiles) {
+    corpus->name = name;
+    corpus->numFiles = 0;
+    corpus->bytes = 0;
+    corpus->tree = false;
+    corpus->files = malloc((numFiles + 1) * sizeof(char *));
+    if (!corpus->files) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    if (mkdir(name, 0755) == -1 || chdir(name) == -1) {
+        perror("Error creating corpus directory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void buildTinyCorpus(Corpus *corpus, int numFiles) {
+    createCorpus(corpus, "tiny", numFiles);
+    for (int i = 0; i < numFiles; i++) {
+        addCorpusFile(corpus, i, 1 + nextRandom() % 512, false);
+    }
+}
+
+static void buildLargeCorpus(Corpus *corpus, int numFiles, uint64_t sizeMB) {
+    createCorpus(corpus, "large", numFiles);
+    for (int i = 0; i < numFiles; i++) {
+        addCorpusFile(corpus, i, sizeMB * 1024 * 1024, false);
+    }
+}
+
+// Log-uniform sizes from 1 byte to 4 MB; every 16th file is binary
+static void buildMixedCorpus(Corpus *corpus, int numFiles) {
+    createCorpus(corpus, "mixed", numFiles);
+    corpus->tree = true;
+    for (int i = 0; i < numFiles; i++) {
+        int sizeBits = nextRandom() % 23;
+        uint64_t size = ((uint64_t)1 << sizeBits) + nextRandom() % ((uint64_t)1 << sizeBits);
+        addCorpusFile(corpus, i, size, i % 16 == 15);
+    }
+}
+
+// Counts the syscalls made by argv and every thread it starts. Each syscall
+// stops the tracee twice, on entry and on exit.
+static long countSyscalls(char *const argv[]) {
+    pid_t child = fork();
+    if (child == -1) {
+        return -1;
+    }
+    if (child == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) {
+            _exit(127);
+        }
+        raise(SIGSTOP);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(child, &status, 0) == -1 || !WIFSTOPPED(status)) {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, NULL,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+    long stops = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, __WALL)) > 0) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            continue;
+        }
+        int signal = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            stops++;
+        } else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+            signal = WSTOPSIG(status);  // Pass real signals through
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, signal);
+    }
+    return stops / 2;
+}
+
+static void runCommand(char *const argv[], bool countCalls, RunResult *result) {
+    struct rusage usage;
+    int status;
+    double start = now();
+
+    pid_t child = fork();
+    if (child == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (child == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (wait4(child, &status, 0, &usage) == -1) {
+        perror("wait4");
+        exit(EXIT_FAILURE);
+    }
+
+    result->seconds = now() - start;
+    result->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    result->userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    result->systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result->maxRssKb = usage.ru_maxrss;
+    result->syscalls = countCalls ? countSyscalls(argv) : -1;
+}
+
+static bool ioUring;
+
+static void report(const Corpus *corpus, const char *op, const RunResult *result) {
+    printf("{\"corpus\":\"%s\",\"op\":\"%s\",\"status\":%d,\"files\":%d,\"bytes\":%llu,"
+           "\"seconds\":%.6f,\"mb_per_s\":%.2f,\"files_per_s\":%.1f,\"user_s\":%.6f,\"sys_s\":%.6f,"
+           "\"max_rss_kb\":%ld,\"syscalls\":%ld,\"io_uring\":%s}\n",
+           corpus->name, op, result->status, corpus->numFiles, (unsigned long long)corpus->bytes,
+           result->seconds, corpus->bytes / 1e6 / result->seconds, corpus->numFiles / result->seconds,
+           result->userSeconds, result->systemSeconds, result->maxRssKb, result->syscalls,
+           ioUring ? "true" : "false");
+    fflush(stdout);
+}
+
+static int removeEntry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    return remove(path);
+}
+
+// Builds an archive of the corpus in the current directory, extracts it
+// next to it and reports both runs
+static void benchCorpus(Corpus *corpus, const char *tarsau, const char *threads, bool countCalls) {
+    RunResult result;
+    char **argv = malloc((corpus->numFiles + 9) * sizeof(char *));
+    if (!argv) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Benchmarking %s (%d files, %llu bytes)\n", corpus->name, corpus->numFiles,
+            (unsigned long long)corpus->bytes);
+
+    int argc = 0;
+    argv[argc++] = (char *)tarsau;
+    if (ioUring) {
+        argv[argc++] = "--io-uring";
+    }
+    argv[argc++] = "-b";
+    argv[argc++] = "-j";
+    argv[argc++] = (char *)threads;
+    if (corpus->tree) {
+        argv[argc++] = ".";
+    } else {
+        for (int i = 0; i < corpus->numFiles; i++) {
+            argv[argc++] = corpus->files[i];
+        }
+    }
+    argv[argc++] = "-o";
+    argv[argc++] = "../bench.sau";
+    argv[argc] = NULL;
+    runCommand(argv, countCalls, &result);
+    report(corpus, "build", &result);
+
+    char *extractArgv[] = {(char *)tarsau, "-a", "../bench.sau", "../extract", "-j", (char *)threads,
+                           ioUring ? "--io-uring" : NULL, NULL};
+    nftw("../extract", removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    mkdir("../extract", 0755);
+    runCommand(extractArgv, false, &result);
+    if (countCalls) {
+        nftw("../extract", removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+        mkdir("../extract", 0755);
+        result.syscalls = countSyscalls(extractArgv);
+    }
+    report(corpus, "extract", &result);
+
+    nftw("../extract", removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    remove("../bench.sau");
+    for (int i = 0; i < corpus->numFiles; i++) {
+        free(corpus->files[i]);
+    }
+    free(corpus->files);
+    free(argv);
+
+    // Leave the corpus directory and delete it
+    if (chdir("..") == -1) {
+        perror("chdir");
+        exit(EXIT_FAILURE);
+    }
+    nftw(corpus->name, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int main(int argc, char *argv[]) {
+    const char *threads = "1";
+    int tinyFiles = 100000;
+    int largeFiles = 3;
+    uint64_t largeMB = 2048;
+    int mixedFiles = 2000;
+    const char *workDirectory = "tarsau_bench.tmp";
+    bool countCalls = true;
+    int option;
+
+    while ((option = getopt(argc, argv, "j:n:L:S:m:w:xU")) != -1) {
+        switch (option) {
+        case 'j': threads = optarg; break;
+        case 'n': tinyFiles = atoi(optarg); break;
+        case 'L': largeFiles = atoi(optarg); break;
+        case 'S': largeMB = strtoull(optarg, NULL, 10); break;
+        case 'm': mixedFiles = atoi(optarg); break;
+        case 'w': workDirectory = optarg; break;
+        case 'x': countCalls = false; break;
+        case 'U': ioUring = true; break;
+        default:
+            fprintf(stderr, "Usage: %s [-j threads] [-n tiny_files] [-L large_files] [-S large_MB] "
+                            "[-m mixed_files] [-w workdir] [-x] [-U] path_to_tarsau\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Path to the tarsau executable not provided.\n");
+        return EXIT_FAILURE;
+    }
+    char *tarsau = realpath(argv[optind], NULL);
+    if (!tarsau) {
+        perror("Error locating tarsau");
+        return EXIT_FAILURE;
+    }
+
+    if (mkdir(workDirectory, 0755) == -1 || chdir(workDirectory) == -1) {
+        perror("Error creating work directory");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpus;
+    if (tinyFiles > 0) {
+        buildTinyCorpus(&corpus, tinyFiles);
+        benchCorpus(&corpus, tarsau, threads, countCalls);
+    }
+    if (largeFiles > 0 && largeMB > 0) {
+        buildLargeCorpus(&corpus, largeFiles, largeMB);
+        benchCorpus(&corpus, tarsau, threads, countCalls);
+    }
+    if (mixedFiles > 0) {
+        buildMixedCorpus(&corpus, mixedFiles);
+        benchCorpus(&corpus, tarsau, threads, countCalls);
+    }
+
+    if (chdir("..") == -1) {
+        perror("chdir");
+        return EXIT_FAILURE;
+    }
+    rmdir(workDirectory);
+    free(tarsau);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+#include "binscan.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BINSCAN_X86 1
+#endif
+
+typedef bool (*ContainsNulFn)(const void *data, size_t length);
+
+bool containsNulScalar(const void *data, size_t length) {
+    const unsigned char *bytes = data;
+
+    // Check a word at a time using the classic "has zero byte" trick
+    while (length >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        if ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) {
+            return true;
+        }
+        bytes += sizeof(word);
+        length -= sizeof(word);
+    }
+    while (length > 0) {
+        if (*bytes == 0) {
+            return true;
+        }
+        bytes++;
+        length--;
+    }
+    return false;
+}
+
+#ifdef BINSCAN_X86
+__attribute__((target("sse2")))
+static bool containsNulSse2(const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    const __m128i zero = _mm_setzero_si128();
+
+    // Four vectors per iteration, OR-ed together so there is only one branch
+    while (length >= 64) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)bytes), zero);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + 16)), zero);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + 32)), zero);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bytes + 48)), zero);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) {
+            return true;
+        }
+        bytes += 64;
+        length -= 64;
+    }
+    while (length >= 16) {
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)bytes), zero))) {
+            return true;
+        }
+        bytes += 16;
+        length -= 16;
+    }
+    return containsNulScalar(bytes, length);
+}
+
+__attribute__((target("avx2")))
+static bool containsNulAvx2(const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    const __m256i zero = _mm256_setzero_si256();
+
+    while (length >= 128) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)bytes), zero);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(bytes + 32)), zero);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(bytes + 64)), zero);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(bytes + 96)), zero);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)) ||
+            !_mm256_testz_si256(_mm256_or_si256(c, d), _mm256_or_si256(c, d))) {
+            return true;
+        }
+        bytes += 128;
+        length -= 128;
+    }
+    while (length >= 32) {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)bytes), zero);
+        if (_mm256_movemask_epi8(m)) {
+            return true;
+        }
+        bytes += 32;
+        length -= 32;
+    }
+    return containsNulScalar(bytes, length);
+}
+#endif
+
+static ContainsNulFn selectedImplementation;
+static const char *selectedName;
+
+// Runs before main so worker threads never race on the dispatch pointer
+__attribute__((constructor))
+static void selectImplementation(void) {
+    selectedImplementation = containsNulScalar;
+    selectedName = "scalar";
+#ifdef BINSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        selectedImplementation = containsNulAvx2;
+        selectedName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        selectedImplementation = containsNulSse2;
+        selectedName = "sse2";
+    }
+#endif
+}
+
+bool containsNul(const void *data, size_t length) {
+    return selectedImplementation(data, length);
+}
+
+const char *containsNulImplementation(void) {
+    return selectedName;
+}
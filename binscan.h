@@ -0,0 +1,19 @@
+#ifndef BINSCAN_H
+#define BINSCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Returns true if the block contains a NUL byte, which is how tarsau tells
+// binary inputs apart from text. The fastest implementation supported by the
+// running CPU (AVX2, SSE2 or scalar) is picked at program start-up.
+bool containsNul(const void *data, size_t length);
+
+// Portable word-at-a-time version, also used for the tails of SIMD scans.
+bool containsNulScalar(const void *data, size_t length);
+
+// Name of the implementation containsNul dispatches to ("avx2", "sse2" or
+// "scalar").
+const char *containsNulImplementation(void);
+
+#endif
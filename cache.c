@@ -0,0 +1,200 @@
+#include "cache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "sauformat.h"
+
+typedef struct {
+    CacheEntry entry;
+    const char *path;  // Inside the loaded sidecar, not NUL-terminated
+    uint32_t pathLength;
+} CacheRecord;
+
+// Paths are found through an open-addressing table of record indices + 1
+struct BuildCache {
+    unsigned char *data;  // The whole sidecar
+    CacheRecord *records;
+    uint64_t count;
+    uint64_t *slots;
+    uint64_t numSlots;  // Power of two
+};
+
+static void encodeHeader(unsigned char *p, uint64_t count, uint64_t archiveSize, uint64_t archiveInode,
+                         int64_t archiveMtimeSec, uint32_t archiveMtimeNsec) {
+    memset(p, 0, CACHE_HEADER_SIZE);
+    memcpy(p, CACHE_MAGIC, SAU_MAGIC_SIZE);
+    sauPutU32(p + 4, CACHE_VERSION);
+    sauPutU64(p + 8, count);
+    sauPutU64(p + 16, archiveSize);
+    sauPutU64(p + 24, archiveInode);
+    sauPutU64(p + 32, (uint64_t)archiveMtimeSec);
+    sauPutU32(p + 40, archiveMtimeNsec);
+}
+
+// Reads the whole file at path, or returns NULL
+static unsigned char *readSidecar(const char *path, uint64_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    struct stat st;
+    unsigned char *data = NULL;
+    if (fstat(fileno(file), &st) == 0 && st.st_size >= CACHE_HEADER_SIZE && (uint64_t)st.st_size <= SIZE_MAX) {
+        data = malloc(st.st_size);
+        if (data && fread(data, 1, st.st_size, file) != (size_t)st.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *length = st.st_size;
+    }
+    fclose(file);
+    return data;
+}
+
+BuildCache *cacheLoad(const char *path, uint64_t archiveSize, uint64_t archiveInode, int64_t archiveMtimeSec,
+                      uint32_t archiveMtimeNsec) {
+    BuildCache *cache = calloc(1, sizeof(BuildCache));
+    if (!cache) {
+        return NULL;
+    }
+    uint64_t length = 0;
+    cache->data = readSidecar(path, &length);
+    if (!cache->data) {
+        return cache;
+    }
+
+    unsigned char expected[CACHE_HEADER_SIZE];
+    uint64_t count = sauGetU64(cache->data + 8);
+    encodeHeader(expected, count, archiveSize, archiveInode, archiveMtimeSec, archiveMtimeNsec);
+    if (memcmp(cache->data, expected, CACHE_HEADER_SIZE) != 0 ||
+        count > (length - CACHE_HEADER_SIZE) / CACHE_ENTRY_SIZE) {
+        return cache;  // Stale or not a sidecar: start from nothing
+    }
+
+    uint64_t numSlots = 1;
+    while (numSlots < 2 * count) {
+        numSlots <<= 1;
+    }
+    cache->records = malloc((count ? count : 1) * sizeof(CacheRecord));
+    cache->slots = calloc(numSlots, sizeof(uint64_t));
+    if (!cache->records || !cache->slots) {
+        cacheFree(cache);
+        return NULL;
+    }
+    cache->numSlots = numSlots;
+
+    uint64_t position = CACHE_HEADER_SIZE;
+    for (uint64_t i = 0; i < count; i++) {
+        if (length - position < CACHE_ENTRY_SIZE) {
+            break;
+        }
+        const unsigned char *p = cache->data + position;
+        CacheRecord *record = &cache->records[cache->count];
+        record->entry.key.size = sauGetU64(p);
+        record->entry.key.mtimeSec = (int64_t)sauGetU64(p + 8);
+        record->entry.key.mtimeNsec = sauGetU32(p + 16);
+        record->entry.key.mode = sauGetU32(p + 20);
+        record->entry.key.inode = sauGetU64(p + 24);
+        record->entry.key.ctimeSec = (int64_t)sauGetU64(p + 32);
+        record->entry.key.ctimeNsec = sauGetU32(p + 40);
+        record->entry.recordOffset = sauGetU64(p + 44);
+        record->entry.dataOffset = sauGetU64(p + 52);
+        record->entry.storedSize = sauGetU64(p + 60);
+        record->entry.flags = sauGetU32(p + 68);
+        record->entry.checksum = sauGetU32(p + 72);
+        record->pathLength = sauGetU32(p + 76);
+        position += CACHE_ENTRY_SIZE;
+        if (record->pathLength > length - position || record->entry.dataOffset < record->entry.recordOffset ||
+            record->entry.storedSize > archiveSize || record->entry.dataOffset > archiveSize - record->entry.storedSize) {
+            break;
+        }
+        record->path = (const char *)cache->data + position;
+        position += record->pathLength;
+
+        uint64_t slot = sauHashName(record->path, record->pathLength) & (numSlots - 1);
+        while (cache->slots[slot] != 0) {
+            slot = (slot + 1) & (numSlots - 1);
+        }
+        cache->slots[slot] = ++cache->count;
+    }
+    return cache;
+}
+
+void cacheFree(BuildCache *cache) {
+    if (!cache) {
+        return;
+    }
+    free(cache->data);
+    free(cache->records);
+    free(cache->slots);
+    free(cache);
+}
+
+const CacheEntry *cacheFind(const BuildCache *cache, const char *path) {
+    if (cache->count == 0) {
+        return NULL;
+    }
+    size_t pathLength = strlen(path);
+    uint64_t mask = cache->numSlots - 1;
+    for (uint64_t slot = sauHashName(path, pathLength) & mask; cache->slots[slot] != 0; slot = (slot + 1) & mask) {
+        const CacheRecord *record = &cache->records[cache->slots[slot] - 1];
+        if (record->pathLength == pathLength && memcmp(record->path, path, pathLength) == 0) {
+            return &record->entry;
+        }
+    }
+    return NULL;
+}
+
+int cacheSave(const char *path, uint64_t archiveSize, uint64_t archiveInode, int64_t archiveMtimeSec,
+              uint32_t archiveMtimeNsec, const MemberList *members, const CacheKey *keys) {
+    char temporaryPath[PATH_MAX];
+    if ((size_t)snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path) >= sizeof(temporaryPath)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    FILE *file = fopen(temporaryPath, "wb");
+    if (!file) {
+        return -1;
+    }
+
+    unsigned char header[CACHE_HEADER_SIZE];
+    encodeHeader(header, members->count, archiveSize, archiveInode, archiveMtimeSec, archiveMtimeNsec);
+    fwrite(header, 1, sizeof(header), file);
+    for (uint64_t i = 0; i < members->count; i++) {
+        const FileInfo *fileInfo = &members->members[i];
+        const char *name = memberName(members, fileInfo);
+        unsigned char p[CACHE_ENTRY_SIZE];
+        sauPutU64(p, keys[i].size);
+        sauPutU64(p + 8, (uint64_t)keys[i].mtimeSec);
+        sauPutU32(p + 16, keys[i].mtimeNsec);
+        sauPutU32(p + 20, keys[i].mode);
+        sauPutU64(p + 24, keys[i].inode);
+        sauPutU64(p + 32, (uint64_t)keys[i].ctimeSec);
+        sauPutU32(p + 40, keys[i].ctimeNsec);
+        sauPutU64(p + 44, fileInfo->offset - SAU_RECORD_HEADER_SIZE - memberArchiveNameLength(fileInfo));
+        sauPutU64(p + 52, fileInfo->offset);
+        sauPutU64(p + 60, fileInfo->storedSize);
+        sauPutU32(p + 68, fileInfo->flags);
+        sauPutU32(p + 72, fileInfo->checksum);
+        sauPutU32(p + 76, fileInfo->nameLength);
+        fwrite(p, 1, sizeof(p), file);
+        fwrite(name, 1, fileInfo->nameLength, file);
+    }
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    if (failed || rename(temporaryPath, path) == -1) {
+        int savedErrno = errno;
+        remove(temporaryPath);
+        errno = savedErrno;
+        return -1;
+    }
+    return 0;
+}
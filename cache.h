@@ -0,0 +1,84 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "members.h"
+
+// Sidecar of an archive built with --cache, kept next to it as
+// "<archive>.cache". For every member it records the stat of the input the
+// member was read from and where the member's record lies in the archive,
+// so the next build can copy the members of unchanged inputs over from the
+// previous archive without reading them. All integers are little-endian:
+//
+//   header  "SAUC" | u32 version | u64 entryCount | u64 archiveSize |
+//           u64 archiveInode | i64 archiveMtimeSec | u32 archiveMtimeNsec |
+//           u32 reserved
+//   entry   u64 size | i64 mtimeSec | u32 mtimeNsec | u32 mode | u64 inode |
+//           i64 ctimeSec | u32 ctimeNsec |
+//           u64 recordOffset | u64 dataOffset | u64 storedSize |
+//           u32 flags | u32 checksum | u32 pathLength
+//           followed by the path the input was opened by
+//
+// A sidecar only describes the archive file it was written with: when the
+// archive's size, inode or modification time no longer match (an update
+// with -u, a build without --cache), it is ignored.
+
+#define CACHE_MAGIC "SAUC"
+#define CACHE_VERSION 2
+#define CACHE_HEADER_SIZE 48
+#define CACHE_ENTRY_SIZE 80
+
+// What an input looked like when it was archived. An input whose stat
+// still matches is taken to be unchanged. Its content is not compared:
+// hashing it would mean reading every input, which is the work the cache
+// exists to skip. The status change time stands in for it, since unlike
+// the modification time it cannot be set back (touch -d, cp -p, rsync
+// --times), so an edit that keeps the size and restores the mtime still
+// changes the key.
+typedef struct {
+    uint64_t size;
+    int64_t mtimeSec;
+    uint32_t mtimeNsec;
+    uint32_t mode;  // Permission bits
+    uint64_t inode;
+    int64_t ctimeSec;
+    uint32_t ctimeNsec;
+} CacheKey;
+
+typedef struct {
+    CacheKey key;
+    uint64_t recordOffset;  // Member record in the cached archive
+    uint64_t dataOffset;    // Member data, after the record header and name
+    uint64_t storedSize;
+    uint32_t flags;         // SAU_MEMBER_* flags of the member
+    uint32_t checksum;      // CRC-32C of the content, as in the TOC
+} CacheEntry;
+
+typedef struct BuildCache BuildCache;
+
+// Loads the sidecar at path for the archive with the given size, inode and
+// modification time. A missing, stale or malformed sidecar gives an empty
+// cache. Returns NULL only if memory runs out.
+BuildCache *cacheLoad(const char *path, uint64_t archiveSize, uint64_t archiveInode, int64_t archiveMtimeSec,
+                      uint32_t archiveMtimeNsec);
+
+void cacheFree(BuildCache *cache);
+
+// Entry of the input opened by path, or NULL. Safe to call from several
+// threads.
+const CacheEntry *cacheFind(const BuildCache *cache, const char *path);
+
+// Writes the sidecar for members, the archived inputs, with keys[i] the
+// stat of members->members[i]. The file is written aside and renamed into
+// place. Returns -1 with errno set on failure.
+int cacheSave(const char *path, uint64_t archiveSize, uint64_t archiveInode, int64_t archiveMtimeSec,
+              uint32_t archiveMtimeNsec, const MemberList *members, const CacheKey *keys);
+
+static inline bool cacheKeyEqual(const CacheKey *a, const CacheKey *b) {
+    return a->size == b->size && a->mtimeSec == b->mtimeSec && a->mtimeNsec == b->mtimeNsec &&
+           a->mode == b->mode && a->inode == b->inode && a->ctimeSec == b->ctimeSec && a->ctimeNsec == b->ctimeNsec;
+}
+
+#endif
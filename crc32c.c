@@ -0,0 +1,215 @@
+#include "crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78  // Reflected Castagnoli polynomial
+
+// Lengths of the three interleaved streams of the hardware version
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+typedef uint32_t (*Crc32cFn)(uint32_t crc, const void *data, size_t length);
+
+static uint32_t softwareTable[8][256];
+
+uint32_t crc32cSoftware(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    crc = ~crc;
+
+    // Eight bytes per step, one table lookup each
+    while (length >= 8) {
+        uint32_t low = crc ^ ((uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 |
+                              (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+        crc = softwareTable[7][low & 0xff] ^ softwareTable[6][(low >> 8) & 0xff] ^
+              softwareTable[5][(low >> 16) & 0xff] ^ softwareTable[4][low >> 24] ^
+              softwareTable[3][bytes[4]] ^ softwareTable[2][bytes[5]] ^
+              softwareTable[1][bytes[6]] ^ softwareTable[0][bytes[7]];
+        bytes += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = (crc >> 8) ^ softwareTable[0][(crc ^ *bytes) & 0xff];
+        bytes++;
+        length--;
+    }
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+// Tables that advance a CRC over CRC32C_LONG or CRC32C_SHORT zero bytes, one
+// per byte of the CRC, so the CRCs of the interleaved streams can be joined
+static uint32_t longShift[4][256];
+static uint32_t shortShift[4][256];
+
+// Multiplies the 32x32 GF(2) matrix mat (one column per bit) by vec
+static uint32_t gf2MatrixTimes(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+// Builds the matrix that runs a CRC over length zero bytes, by repeated
+// squaring of the one-zero-bit operator
+static void zerosOperator(uint32_t *even, size_t length) {
+    uint32_t odd[32];
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = 1u << (n - 1);
+    }
+    gf2MatrixSquare(even, odd);  // Two zero bits
+    gf2MatrixSquare(odd, even);  // Four zero bits, i.e. half a byte
+
+    for (;;) {
+        gf2MatrixSquare(even, odd);
+        length >>= 1;
+        if (length == 0) {
+            return;
+        }
+        gf2MatrixSquare(odd, even);
+        length >>= 1;
+        if (length == 0) {
+            memcpy(even, odd, sizeof(odd));
+            return;
+        }
+    }
+}
+
+static void buildShiftTable(uint32_t table[4][256], size_t length) {
+    uint32_t op[32];
+    zerosOperator(op, length);
+    for (uint32_t n = 0; n < 256; n++) {
+        table[0][n] = gf2MatrixTimes(op, n);
+        table[1][n] = gf2MatrixTimes(op, n << 8);
+        table[2][n] = gf2MatrixTimes(op, n << 16);
+        table[3][n] = gf2MatrixTimes(op, n << 24);
+    }
+}
+
+static inline uint32_t shiftCrc(uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static inline uint64_t loadWord(const unsigned char *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+// The crc32 instruction has a latency of three cycles but can start one per
+// cycle, so three independent streams keep it busy. Each stream is
+// checksummed separately and the results are joined with the shift tables.
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    uint64_t crc0 = ~crc;
+
+    while (length > 0 && ((uintptr_t)bytes & 7) != 0) {
+        crc0 = _mm_crc32_u8(crc0, *bytes);
+        bytes++;
+        length--;
+    }
+
+    while (length >= 3 * CRC32C_LONG) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const unsigned char *end = bytes + CRC32C_LONG;
+        do {
+            crc0 = _mm_crc32_u64(crc0, loadWord(bytes));
+            crc1 = _mm_crc32_u64(crc1, loadWord(bytes + CRC32C_LONG));
+            crc2 = _mm_crc32_u64(crc2, loadWord(bytes + 2 * CRC32C_LONG));
+            bytes += 8;
+        } while (bytes < end);
+        crc0 = shiftCrc(longShift, crc0) ^ crc1;
+        crc0 = shiftCrc(longShift, crc0) ^ crc2;
+        bytes += 2 * CRC32C_LONG;
+        length -= 3 * CRC32C_LONG;
+    }
+
+    while (length >= 3 * CRC32C_SHORT) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const unsigned char *end = bytes + CRC32C_SHORT;
+        do {
+            crc0 = _mm_crc32_u64(crc0, loadWord(bytes));
+            crc1 = _mm_crc32_u64(crc1, loadWord(bytes + CRC32C_SHORT));
+            crc2 = _mm_crc32_u64(crc2, loadWord(bytes + 2 * CRC32C_SHORT));
+            bytes += 8;
+        } while (bytes < end);
+        crc0 = shiftCrc(shortShift, crc0) ^ crc1;
+        crc0 = shiftCrc(shortShift, crc0) ^ crc2;
+        bytes += 2 * CRC32C_SHORT;
+        length -= 3 * CRC32C_SHORT;
+    }
+
+    while (length >= 8) {
+        crc0 = _mm_crc32_u64(crc0, loadWord(bytes));
+        bytes += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc0 = _mm_crc32_u8(crc0, *bytes);
+        bytes++;
+        length--;
+    }
+    return ~(uint32_t)crc0;
+}
+#endif
+
+static Crc32cFn selectedImplementation;
+static const char *selectedName;
+
+// Runs before main so worker threads never race on the tables or the
+// dispatch pointer
+__attribute__((constructor))
+static void selectImplementation(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        softwareTable[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t previous = softwareTable[k - 1][n];
+            softwareTable[k][n] = (previous >> 8) ^ softwareTable[0][previous & 0xff];
+        }
+    }
+
+    selectedImplementation = crc32cSoftware;
+    selectedName = "software";
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        buildShiftTable(longShift, CRC32C_LONG);
+        buildShiftTable(shortShift, CRC32C_SHORT);
+        selectedImplementation = crc32cSse42;
+        selectedName = "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    return selectedImplementation(crc, data, length);
+}
+
+const char *crc32cImplementation(void) {
+    return selectedName;
+}
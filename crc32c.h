@@ -0,0 +1,20 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli polynomial, as used by iSCSI and ext4) of the block,
+// continuing from crc: start with 0 and feed the result of one call into the
+// next to checksum data that arrives in pieces. The SSE4.2 crc32 instruction
+// is used when the running CPU has it, otherwise a slicing-by-8 table
+// version; both give the same result.
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+// Portable table-driven version
+uint32_t crc32cSoftware(uint32_t crc, const void *data, size_t length);
+
+// Name of the implementation crc32c dispatches to ("sse4.2" or "software")
+const char *crc32cImplementation(void);
+
+#endif
@@ -0,0 +1,163 @@
+#include "dedup.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Normalized chunking (as in FastCDC): a stricter mask before the average
+// size and a looser one after it keep chunk sizes close to the average.
+#define DEDUP_MASK_SMALL 0x0003590703530000ULL
+#define DEDUP_MASK_LARGE 0x0000d90003530000ULL
+
+static uint64_t gearTable[256];
+
+// Fills the Gear table with fixed pseudo-random values (splitmix64), so
+// chunk boundaries are the same on every run and every machine
+__attribute__((constructor))
+static void initGearTable(void) {
+    uint64_t seed = 0x5341553244454455ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gearTable[i] = z ^ (z >> 31);
+    }
+}
+
+size_t chunkerFeed(Chunker *chunker, const void *data, size_t length, bool *chunkReady) {
+    const unsigned char *bytes = data;
+    size_t room = DEDUP_MAX_CHUNK - chunker->length;
+    size_t limit = length < room ? length : room;
+    uint64_t hash = chunker->hash;
+    size_t consumed = 0;
+
+    *chunkReady = false;
+    while (consumed < limit) {
+        hash = (hash << 1) + gearTable[bytes[consumed]];
+        consumed++;
+
+        size_t chunkLength = chunker->length + consumed;
+        if (chunkLength < DEDUP_MIN_CHUNK) {
+            continue;
+        }
+        uint64_t mask = chunkLength < DEDUP_AVG_CHUNK ? DEDUP_MASK_SMALL : DEDUP_MASK_LARGE;
+        if ((hash & mask) == 0) {
+            *chunkReady = true;
+            break;
+        }
+    }
+
+    memcpy(chunker->chunk + chunker->length, bytes, consumed);
+    chunker->length += consumed;
+    chunker->hash = hash;
+    if (chunker->length == DEDUP_MAX_CHUNK) {
+        *chunkReady = true;
+    }
+    return consumed;
+}
+
+void chunkerReset(Chunker *chunker) {
+    chunker->length = 0;
+    chunker->hash = 0;
+}
+
+typedef struct {
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    uint64_t offset;  // 0: empty slot, or a forgotten chunk
+    uint32_t length;
+    uint32_t owner;
+} DedupSlot;
+
+struct DedupStore {
+    DedupSlot *slots;
+    size_t capacity;  // Power of two
+    size_t used;
+};
+
+DedupStore *dedupStoreCreate(void) {
+    DedupStore *store = calloc(1, sizeof(DedupStore));
+    if (!store) {
+        return NULL;
+    }
+    store->capacity = 1024;
+    store->slots = calloc(store->capacity, sizeof(DedupSlot));
+    if (!store->slots) {
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+void dedupStoreFree(DedupStore *store) {
+    if (store) {
+        free(store->slots);
+        free(store);
+    }
+}
+
+static size_t slotFor(const DedupStore *store, const unsigned char digest[SHA256_DIGEST_SIZE]) {
+    uint64_t start;
+    memcpy(&start, digest, sizeof(start));  // SHA-256 output is already uniform
+    return start & (store->capacity - 1);
+}
+
+uint64_t dedupStoreFind(DedupStore *store, const unsigned char digest[SHA256_DIGEST_SIZE], uint32_t length) {
+    size_t mask = store->capacity - 1;
+    for (size_t slot = slotFor(store, digest); store->slots[slot].length != 0; slot = (slot + 1) & mask) {
+        DedupSlot *candidate = &store->slots[slot];
+        if (candidate->offset != 0 && candidate->length == length &&
+            memcmp(candidate->digest, digest, SHA256_DIGEST_SIZE) == 0) {
+            return candidate->offset;
+        }
+    }
+    return 0;
+}
+
+static void insertSlot(DedupStore *store, const DedupSlot *entry) {
+    size_t mask = store->capacity - 1;
+    size_t slot = slotFor(store, entry->digest);
+    while (store->slots[slot].length != 0) {
+        slot = (slot + 1) & mask;
+    }
+    store->slots[slot] = *entry;
+    store->used++;
+}
+
+int dedupStoreAdd(DedupStore *store, const unsigned char digest[SHA256_DIGEST_SIZE], uint64_t offset,
+                  uint32_t length, uint32_t owner) {
+    // Keep the table at most 70% full
+    if ((store->used + 1) * 10 > store->capacity * 7) {
+        DedupSlot *old = store->slots;
+        size_t oldCapacity = store->capacity;
+        store->slots = calloc(oldCapacity * 2, sizeof(DedupSlot));
+        if (!store->slots) {
+            store->slots = old;
+            return -1;
+        }
+        store->capacity = oldCapacity * 2;
+        store->used = 0;
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i].length != 0 && old[i].offset != 0) {
+                insertSlot(store, &old[i]);
+            }
+        }
+        free(old);
+    }
+
+    DedupSlot entry;
+    memcpy(entry.digest, digest, SHA256_DIGEST_SIZE);
+    entry.offset = offset;
+    entry.length = length;
+    entry.owner = owner;
+    insertSlot(store, &entry);
+    return 0;
+}
+
+void dedupStoreForget(DedupStore *store, uint32_t owner) {
+    // Slots stay occupied so probe chains are not broken; a zero offset
+    // makes them invisible to lookups until the next resize drops them
+    for (size_t i = 0; i < store->capacity; i++) {
+        if (store->slots[i].length != 0 && store->slots[i].owner == owner) {
+            store->slots[i].offset = 0;
+        }
+    }
+}
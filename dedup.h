@@ -0,0 +1,50 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+// Content-defined chunking: boundaries are picked by a rolling Gear hash of
+// the data itself, so an insertion early in a file only changes the chunks
+// around it and the rest still match chunks seen before.
+#define DEDUP_MIN_CHUNK (2 * 1024)
+#define DEDUP_AVG_CHUNK (8 * 1024)
+#define DEDUP_MAX_CHUNK (64 * 1024)
+
+typedef struct {
+    unsigned char chunk[DEDUP_MAX_CHUNK];
+    size_t length;
+    uint64_t hash;
+} Chunker;
+
+// Appends data to the current chunk until a boundary is found. Returns the
+// number of bytes consumed and sets *chunkReady when chunker->chunk holds a
+// complete chunk; the caller then handles it and calls chunkerReset. At the
+// end of a member whatever is left in the chunker is the last chunk.
+size_t chunkerFeed(Chunker *chunker, const void *data, size_t length, bool *chunkReady);
+
+void chunkerReset(Chunker *chunker);
+
+// Maps the SHA-256 of every chunk stored so far to where its bytes live in
+// the archive.
+typedef struct DedupStore DedupStore;
+
+DedupStore *dedupStoreCreate(void);
+
+void dedupStoreFree(DedupStore *store);
+
+// Returns the archive offset of an identical chunk stored earlier, or 0
+uint64_t dedupStoreFind(DedupStore *store, const unsigned char digest[SHA256_DIGEST_SIZE], uint32_t length);
+
+// Records a newly stored chunk; owner identifies the member it belongs to.
+// Returns -1 if memory runs out.
+int dedupStoreAdd(DedupStore *store, const unsigned char digest[SHA256_DIGEST_SIZE], uint64_t offset,
+                  uint32_t length, uint32_t owner);
+
+// Forgets every chunk added by owner, for members rolled back mid-write
+void dedupStoreForget(DedupStore *store, uint32_t owner);
+
+#endif
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include "dircache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sauformat.h"
+#include "stats.h"
+
+#define DIR_CACHE_MIN_ENTRIES 16
+
+typedef struct {
+    char *path;  // Relative to the target, without a trailing '/'
+    size_t length;
+    int fd;
+} DirEntry;
+
+// Directories are found through an open-addressing table of entry indices + 1
+struct DirCache {
+    int rootFd;
+    pthread_mutex_t lock;
+    DirEntry *entries;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t *slots;
+    uint64_t numSlots;  // Power of two, at least twice capacity
+    uint64_t maxEntries;  // Directories kept open at most
+};
+
+DirCache *dirCacheOpen(const char *path) {
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return NULL;
+    }
+    DirCache *cache = calloc(1, sizeof(DirCache));
+    if (!cache) {
+        return NULL;
+    }
+    cache->rootFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (cache->rootFd == -1) {
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+
+    // Leave the other half of the descriptors to archives and member files
+    struct rlimit limit;
+    cache->maxEntries = DIR_CACHE_MIN_ENTRIES;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+        limit.rlim_cur / 2 > DIR_CACHE_MIN_ENTRIES) {
+        cache->maxEntries = limit.rlim_cur / 2;
+    }
+    return cache;
+}
+
+void dirCacheClose(DirCache *cache) {
+    if (!cache) {
+        return;
+    }
+    for (uint64_t i = 0; i < cache->count; i++) {
+        close(cache->entries[i].fd);
+        free(cache->entries[i].path);
+    }
+    close(cache->rootFd);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache->slots);
+    free(cache);
+}
+
+int dirCacheFd(const DirCache *cache) {
+    return cache->rootFd;
+}
+
+// Descriptor of the cached directory path, or -1. Called with the lock held.
+static int findDirectory(const DirCache *cache, const char *path, size_t length) {
+    if (cache->count == 0) {
+        return -1;
+    }
+    uint64_t mask = cache->numSlots - 1;
+    for (uint64_t slot = sauHashName(path, length) & mask; cache->slots[slot] != 0; slot = (slot + 1) & mask) {
+        const DirEntry *entry = &cache->entries[cache->slots[slot] - 1];
+        if (entry->length == length && memcmp(entry->path, path, length) == 0) {
+            return entry->fd;
+        }
+    }
+    return -1;
+}
+
+// Adds an open directory. Called with the lock held; returns -1 if memory
+// runs out, in which case the caller keeps the descriptor.
+static int addDirectory(DirCache *cache, const char *path, size_t length, int fd) {
+    if (cache->count == cache->capacity) {
+        uint64_t capacity = cache->capacity ? 2 * cache->capacity : 64;
+        DirEntry *entries = realloc(cache->entries, capacity * sizeof(DirEntry));
+        uint64_t *slots = calloc(2 * capacity, sizeof(uint64_t));
+        if (entries) {
+            cache->entries = entries;
+        }
+        if (!entries || !slots) {
+            free(slots);
+            return -1;
+        }
+        free(cache->slots);
+        cache->slots = slots;
+        cache->numSlots = 2 * capacity;
+        cache->capacity = capacity;
+        for (uint64_t i = 0; i < cache->count; i++) {
+            uint64_t slot = sauHashName(entries[i].path, entries[i].length) & (cache->numSlots - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (cache->numSlots - 1);
+            }
+            slots[slot] = i + 1;
+        }
+    }
+
+    DirEntry *entry = &cache->entries[cache->count];
+    entry->path = malloc(length + 1);
+    if (!entry->path) {
+        return -1;
+    }
+    memcpy(entry->path, path, length);
+    entry->path[length] = '\0';
+    entry->length = length;
+    entry->fd = fd;
+    uint64_t slot = sauHashName(path, length) & (cache->numSlots - 1);
+    while (cache->slots[slot] != 0) {
+        slot = (slot + 1) & (cache->numSlots - 1);
+    }
+    cache->slots[slot] = ++cache->count;
+    return 0;
+}
+
+// Returns a descriptor of the directory made of the first length bytes of
+// path, creating it and its parents as needed. *temporary is set when the
+// descriptor is not cached and must be closed by the caller.
+static int openDirectory(DirCache *cache, const char *path, size_t length, bool *temporary) {
+    *temporary = false;
+    if (length == 0) {
+        return cache->rootFd;
+    }
+    pthread_mutex_lock(&cache->lock);
+    int fd = findDirectory(cache, path, length);
+    pthread_mutex_unlock(&cache->lock);
+    if (fd != -1) {
+        return fd;
+    }
+
+    size_t nameStart = length;
+    while (nameStart > 0 && path[nameStart - 1] != '/') {
+        nameStart--;
+    }
+    bool parentTemporary;
+    int parentFd = openDirectory(cache, path, nameStart > 0 ? nameStart - 1 : 0, &parentTemporary);
+    if (parentFd == -1) {
+        return -1;
+    }
+    char name[NAME_MAX + 1];
+    size_t nameLength = length - nameStart;
+    if (nameLength == 0 || (nameLength == 1 && path[nameStart] == '.')) {
+        // "a//b" or "a/./b": the same directory as its parent
+        *temporary = parentTemporary;
+        return parentFd;
+    }
+    if (nameLength > NAME_MAX) {
+        if (parentTemporary) {
+            close(parentFd);
+        }
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(name, path + nameStart, nameLength);
+    name[nameLength] = '\0';
+
+    fd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT && (mkdirat(parentFd, name, 0755) == 0 || errno == EEXIST)) {
+        fd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    statsAdd(STATS_OPEN_CALLS, 1);
+    int savedErrno = errno;
+    if (parentTemporary) {
+        close(parentFd);
+    }
+    if (fd == -1) {
+        errno = savedErrno;
+        return -1;
+    }
+
+    // Another thread may have opened the same directory meanwhile
+    pthread_mutex_lock(&cache->lock);
+    int cached = findDirectory(cache, path, length);
+    if (cached == -1 && (cache->count >= cache->maxEntries || addDirectory(cache, path, length, fd) == -1)) {
+        *temporary = true;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (cached != -1) {
+        close(fd);
+        return cached;
+    }
+    return fd;
+}
+
+int dirCacheCreateFile(DirCache *cache, const char *path, mode_t mode) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    bool temporary;
+    int dirFd = openDirectory(cache, path, slash ? (size_t)(slash - path) : 0, &temporary);
+    if (dirFd == -1) {
+        return -1;
+    }
+
+    int fd = openat(dirFd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd == -1 && errno == EACCES && unlinkat(dirFd, name, 0) == 0) {
+        fd = openat(dirFd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    }
+    int savedErrno = errno;
+    if (temporary) {
+        close(dirFd);
+    }
+    errno = savedErrno;
+    return fd;
+}
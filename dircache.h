@@ -0,0 +1,32 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <sys/types.h>
+
+// Directories of an extraction target, kept open so member files are
+// created with openat relative to their parent instead of by a path lookup
+// from the top for each one. Each missing directory is created the first
+// time a member below it is, with mkdirat relative to its own parent, and
+// then stays open. Once half of the descriptor limit is held, further
+// directories are opened for the call that needs them and closed again.
+
+typedef struct DirCache DirCache;
+
+// Opens the target directory at path, creating it if it does not exist.
+// Returns NULL with errno set on failure.
+DirCache *dirCacheOpen(const char *path);
+
+void dirCacheClose(DirCache *cache);
+
+// Descriptor of the target directory itself, owned by the cache
+int dirCacheFd(const DirCache *cache);
+
+// Opens path, relative to the target, for writing: an existing file is
+// truncated, or replaced if it cannot be opened for writing (its stored
+// mode may lack write permission), and missing parent directories are
+// created. New files are created with mode. Path must not be absolute or
+// contain ".." components. Returns the descriptor, or -1 with errno set.
+// Safe to call from several threads.
+int dirCacheCreateFile(DirCache *cache, const char *path, mode_t mode);
+
+#endif
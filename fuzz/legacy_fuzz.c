@@ -0,0 +1,237 @@
+// Fuzz harness for the version 1 header parser. Every input is parsed in one
+// piece and again split at pseudo-random points, and both parses must see
+// the same entries; entries are then escaped again, reparsed and compared
+// with the originals.
+//
+// Built with -DLEGACY_FUZZ_LIBFUZZER it only provides the libFuzzer entry
+// point. Otherwise main runs the files given as arguments, or mutates
+// generated headers for a number of rounds:
+//
+// Usage: legacy_fuzz [-n rounds] [-s seed] [file...]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../legacy.h"
+
+#define MAX_ENTRIES 256
+
+typedef struct {
+    char *names;  // Each name NUL-terminated, in entry order
+    size_t namesLength;
+    uint32_t modes[MAX_ENTRIES];
+    uint64_t sizes[MAX_ENTRIES];
+    size_t nameLengths[MAX_ENTRIES];
+    size_t count;
+} Entries;
+
+static int addEntry(void *context, const char *name, size_t nameLength, uint32_t mode, uint64_t size) {
+    Entries *entries = context;
+    if (strlen(name) != nameLength || nameLength == 0) {
+        abort();
+    }
+    if (entries->count == MAX_ENTRIES) {
+        return -1;
+    }
+    char *names = realloc(entries->names, entries->namesLength + nameLength + 1);
+    if (!names) {
+        abort();
+    }
+    memcpy(names + entries->namesLength, name, nameLength + 1);
+    entries->names = names;
+    entries->namesLength += nameLength + 1;
+    entries->modes[entries->count] = mode;
+    entries->sizes[entries->count] = size;
+    entries->nameLengths[entries->count] = nameLength;
+    entries->count++;
+    return 0;
+}
+
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Parses data in pieces whose sizes come from seed, or in one piece if seed
+// is 0. Returns the bytes consumed, or -1.
+static ssize_t parse(const uint8_t *data, size_t length, uint64_t seed, Entries *entries) {
+    LegacyParser parser;
+    legacyParserInit(&parser);
+    memset(entries, 0, sizeof(*entries));
+    size_t offset = 0;
+    while (offset < length && !parser.done) {
+        size_t piece = seed ? 1 + nextRandom(&seed) % 17 : length;
+        if (piece > length - offset) {
+            piece = length - offset;
+        }
+        ssize_t consumed = legacyParse(&parser, (const char *)data + offset, piece, addEntry, entries);
+        if (consumed == -1) {
+            return -1;
+        }
+        if ((size_t)consumed != piece && !parser.done) {
+            abort();  // Only the end of the header stops a piece short
+        }
+        offset += consumed;
+    }
+    if (parser.length != offset) {
+        abort();
+    }
+    return parser.done ? (ssize_t)offset : -1;
+}
+
+static void freeEntries(Entries *entries) {
+    free(entries->names);
+    entries->names = NULL;
+}
+
+static int sameEntries(const Entries *a, const Entries *b) {
+    if (a->count == 0 || b->count == 0) {
+        return a->count == b->count;
+    }
+    return a->count == b->count && a->namesLength == b->namesLength &&
+           memcmp(a->names, b->names, a->namesLength) == 0 &&
+           memcmp(a->modes, b->modes, a->count * sizeof(a->modes[0])) == 0 &&
+           memcmp(a->sizes, b->sizes, a->count * sizeof(a->sizes[0])) == 0;
+}
+
+// Writes entries back out as writeArchiveHeader would, names escaped, and
+// pads the header as if it had shrunk
+static uint8_t *writeEntries(const Entries *entries, size_t *length) {
+    char *header = NULL;
+    FILE *file = open_memstream(&header, length);
+    if (!file) {
+        abort();
+    }
+    fprintf(file, "Size: %010d|", 0);
+    const char *name = entries->names;
+    for (size_t i = 0; i < entries->count; i++) {
+        if (i > 0) {
+            fputc('|', file);
+        }
+        if (legacyWriteName(file, name, entries->nameLengths[i]) == -1) {
+            abort();
+        }
+        fprintf(file, ",%o,%llu", (unsigned)entries->modes[i], (unsigned long long)entries->sizes[i]);
+        name += entries->nameLengths[i] + 1;
+    }
+    fputs("   \n", file);
+    fclose(file);
+    return (uint8_t *)header;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    Entries whole;
+    Entries pieces;
+    ssize_t wholeLength = parse(data, size, 0, &whole);
+    ssize_t piecesLength = parse(data, size, 0x9e3779b97f4a7c15ULL ^ size, &pieces);
+    if (wholeLength != piecesLength || (wholeLength != -1 && !sameEntries(&whole, &pieces))) {
+        abort();
+    }
+
+    if (wholeLength != -1) {
+        size_t length;
+        uint8_t *header = writeEntries(&whole, &length);
+        Entries again;
+        if (parse(header, length, 0, &again) != (ssize_t)length || !sameEntries(&whole, &again)) {
+            abort();
+        }
+        freeEntries(&again);
+        free(header);
+    }
+    freeEntries(&whole);
+    freeEntries(&pieces);
+    return 0;
+}
+
+#ifndef LEGACY_FUZZ_LIBFUZZER
+
+// A valid header with names full of separators and escapes
+static size_t generate(uint8_t *buffer, size_t capacity, uint64_t *state) {
+    static const char alphabet[] = "ab ,|\\n/.";
+    size_t length = snprintf((char *)buffer, capacity, "Size: %010llu", (unsigned long long)nextRandom(state) % 100000);
+    size_t count = nextRandom(state) % 8;
+    for (size_t i = 0; i < count && length + 64 < capacity; i++) {
+        buffer[length++] = '|';
+        size_t nameLength = 1 + nextRandom(state) % 12;
+        for (size_t j = 0; j < nameLength; j++) {
+            buffer[length++] = alphabet[nextRandom(state) % (sizeof(alphabet) - 1)];
+        }
+        length += snprintf((char *)buffer + length, capacity - length, ",%o,%llu",
+                           (unsigned)(nextRandom(state) % 01000), (unsigned long long)nextRandom(state) % 5000);
+    }
+    buffer[length++] = '\n';
+    return length;
+}
+
+static void runFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    static uint8_t buffer[1 << 20];
+    size_t length = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(buffer, length);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long rounds = 1000000;
+    uint64_t state = 88172645463325252ULL;
+    int option;
+    while ((option = getopt(argc, argv, "n:s:")) != -1) {
+        switch (option) {
+        case 'n':
+            rounds = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            state = strtoull(optarg, NULL, 10) | 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: legacy_fuzz [-n rounds] [-s seed] [file...]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) {
+            runFile(argv[i]);
+        }
+        printf("%d files passed\n", argc - optind);
+        return EXIT_SUCCESS;
+    }
+
+    uint8_t buffer[1024];
+    for (unsigned long long round = 0; round < rounds; round++) {
+        size_t length = generate(buffer, sizeof(buffer), &state);
+        // Flip, insert or cut a few bytes of most headers
+        size_t mutations = nextRandom(&state) % 4;
+        for (size_t i = 0; i < mutations && length > 0; i++) {
+            size_t position = nextRandom(&state) % length;
+            switch (nextRandom(&state) % 3) {
+            case 0:
+                buffer[position] = (uint8_t)nextRandom(&state);
+                break;
+            case 1:
+                if (length < sizeof(buffer)) {
+                    memmove(buffer + position + 1, buffer + position, length - position);
+                    buffer[position] = "|,\\\n 0"[nextRandom(&state) % 6];
+                    length++;
+                }
+                break;
+            default:
+                length = position;
+                break;
+            }
+        }
+        LLVMFuzzerTestOneInput(buffer, length);
+    }
+    printf("%llu rounds passed\n", rounds);
+    return EXIT_SUCCESS;
+}
+
+#endif
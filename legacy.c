@@ -0,0 +1,211 @@
+#include "legacy.h"
+
+#include <string.h>
+
+#define LEGACY_PREFIX "Size: "
+#define LEGACY_PREFIX_LENGTH 6
+#define LEGACY_MODE_DIGITS 6  // Up to 0177777
+
+enum {
+    LEGACY_PREFIX_STATE,
+    LEGACY_TOTAL,
+    LEGACY_NAME,
+    LEGACY_MODE,
+    LEGACY_SIZE,
+    LEGACY_TRAILER  // Padding after the last entry
+};
+
+// Bytes that end a run of plain name bytes
+static const bool nameSpecial[256] = {['\0'] = true, [','] = true, ['|'] = true, ['\\'] = true, ['\n'] = true};
+
+static void startEntry(LegacyParser *parser) {
+    parser->state = LEGACY_NAME;
+    parser->escaped = false;
+    parser->blank = true;
+    parser->nameLength = 0;
+    parser->mode = 0;
+    parser->size = 0;
+    parser->digits = 0;
+}
+
+void legacyParserInit(LegacyParser *parser) {
+    memset(parser, 0, sizeof(*parser));
+    parser->state = LEGACY_PREFIX_STATE;
+}
+
+static int appendName(LegacyParser *parser, char byte) {
+    if (parser->nameLength + 1 >= LEGACY_NAME_MAX) {
+        return -1;
+    }
+    parser->name[parser->nameLength++] = byte;
+    parser->blank = parser->blank && byte == ' ';
+    return 0;
+}
+
+// Adds a decimal digit to *value, failing on overflow
+static int addDigit(uint64_t *value, char byte) {
+    uint64_t digit = byte - '0';
+    if (*value > (UINT64_MAX - digit) / 10) {
+        return -1;
+    }
+    *value = *value * 10 + digit;
+    return 0;
+}
+
+static int emitEntry(LegacyParser *parser, LegacyEntryFn onEntry, void *context) {
+    if (parser->digits == 0) {
+        return -1;
+    }
+    parser->name[parser->nameLength] = '\0';
+    return onEntry(context, parser->name, parser->nameLength, parser->mode, parser->size) == 0 ? 0 : -1;
+}
+
+ssize_t legacyParse(LegacyParser *parser, const char *data, size_t length, LegacyEntryFn onEntry, void *context) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i = 0;
+
+    while (i < length && !parser->done) {
+        unsigned char byte = bytes[i];
+        switch (parser->state) {
+        case LEGACY_PREFIX_STATE:
+            if (byte != (unsigned char)LEGACY_PREFIX[parser->prefixMatched]) {
+                return -1;
+            }
+            if (++parser->prefixMatched == LEGACY_PREFIX_LENGTH) {
+                parser->state = LEGACY_TOTAL;
+            }
+            break;
+
+        case LEGACY_TOTAL:
+            if (byte >= '0' && byte <= '9') {
+                if (addDigit(&parser->totalSize, byte) == -1) {
+                    return -1;
+                }
+                parser->digits++;
+            } else if ((byte == '|' || byte == '\n') && parser->digits > 0) {
+                startEntry(parser);
+                parser->done = byte == '\n';
+            } else {
+                return -1;
+            }
+            break;
+
+        case LEGACY_NAME:
+            if (parser->escaped) {
+                parser->escaped = false;
+                if (byte == 'n') {
+                    byte = '\n';
+                } else if (byte == '\0') {
+                    return -1;
+                } else if (byte != '\\' && byte != ',' && byte != '|' && appendName(parser, '\\') == -1) {
+                    return -1;  // Not an escape: the backslash stands for itself
+                }
+                if (appendName(parser, byte) == -1) {
+                    return -1;
+                }
+                parser->blank = false;
+            } else if (!nameSpecial[byte]) {
+                // Copy the run of plain bytes in one go
+                size_t run = 1;
+                while (i + run < length && !nameSpecial[bytes[i + run]]) {
+                    run++;
+                }
+                if (parser->nameLength + run >= LEGACY_NAME_MAX) {
+                    return -1;
+                }
+                for (size_t j = 0; j < run && parser->blank; j++) {
+                    parser->blank = bytes[i + j] == ' ';
+                }
+                memcpy(parser->name + parser->nameLength, bytes + i, run);
+                parser->nameLength += run;
+                i += run - 1;
+            } else if (byte == '\0') {
+                return -1;  // Not allowed in a path
+            } else if (byte == '\\') {
+                parser->escaped = true;
+                parser->blank = false;
+            } else if (byte == ',') {
+                if (parser->nameLength == 0) {
+                    return -1;
+                }
+                parser->state = LEGACY_MODE;
+            } else if (!parser->blank) {
+                return -1;  // '|' or '\n' inside an entry
+            } else if (byte == '|') {
+                startEntry(parser);  // Empty entry
+            } else {
+                parser->done = true;
+            }
+            break;
+
+        case LEGACY_MODE:
+            if (byte >= '0' && byte <= '7' && parser->digits < LEGACY_MODE_DIGITS) {
+                parser->mode = parser->mode * 8 + (byte - '0');
+                parser->digits++;
+            } else if (byte == ',' && parser->digits > 0) {
+                parser->state = LEGACY_SIZE;
+                parser->digits = 0;
+            } else {
+                return -1;
+            }
+            break;
+
+        case LEGACY_SIZE:
+            if (byte >= '0' && byte <= '9') {
+                if (addDigit(&parser->size, byte) == -1) {
+                    return -1;
+                }
+                parser->digits++;
+            } else if (byte == '|' || byte == ' ' || byte == '\n') {
+                if (emitEntry(parser, onEntry, context) == -1) {
+                    return -1;
+                }
+                if (byte == '|') {
+                    startEntry(parser);
+                } else {
+                    parser->state = LEGACY_TRAILER;
+                    parser->done = byte == '\n';
+                }
+            } else {
+                return -1;
+            }
+            break;
+
+        case LEGACY_TRAILER:
+            if (byte == '\n') {
+                parser->done = true;
+            } else if (byte != ' ') {
+                return -1;
+            }
+            break;
+        }
+        i++;
+    }
+
+    parser->length += i;
+    return i;
+}
+
+long legacyWriteName(FILE *file, const char *name, size_t nameLength) {
+    long written = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= nameLength; i++) {
+        if (i < nameLength && !nameSpecial[(unsigned char)name[i]]) {
+            continue;
+        }
+        // Flush the plain run before name[i], then its escape
+        if (i > start && fwrite(name + start, 1, i - start, file) != i - start) {
+            return -1;
+        }
+        written += i - start;
+        if (i < nameLength) {
+            char escape[2] = {'\\', name[i] == '\n' ? 'n' : name[i]};
+            if (fwrite(escape, 1, sizeof(escape), file) != sizeof(escape)) {
+                return -1;
+            }
+            written += sizeof(escape);
+        }
+        start = i + 1;
+    }
+    return written;
+}
@@ -0,0 +1,58 @@
+#ifndef LEGACY_H
+#define LEGACY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Header of version 1 archives: a single text line
+//
+//   "Size: " totalSize ("|" name "," octalMode "," size)* spaces "\n"
+//
+// followed by the member data in header order. Names are escaped so they may
+// contain the separators: "\\", "\," "\|" and "\n" stand for a backslash, a
+// comma, a bar and a newline. A backslash before any other byte stands for
+// itself, so headers written before escaping existed read the same unless
+// a name contained one of those four pairs. Names cannot hold NUL bytes.
+// Empty and all-space entries are skipped (the writer pads a header that
+// shrank with spaces).
+//
+// The parser is fed the header in pieces of any size and keeps no more
+// than one entry of state, so headers of any length parse in one pass
+// without allocating.
+
+#define LEGACY_NAME_MAX 4096  // Longest unescaped name, NUL included
+
+// Called for each entry; name is unescaped and NUL-terminated. Returning
+// anything but 0 stops the parse, which then fails.
+typedef int (*LegacyEntryFn)(void *context, const char *name, size_t nameLength, uint32_t mode, uint64_t size);
+
+typedef struct {
+    int state;
+    int prefixMatched;   // Bytes of "Size: " seen so far
+    bool escaped;        // The previous name byte was a backslash
+    bool blank;          // The entry so far is empty or spaces only
+    char name[LEGACY_NAME_MAX];
+    size_t nameLength;
+    uint32_t mode;
+    uint64_t size;
+    int digits;          // Digits of the number being read
+    uint64_t totalSize;  // The "Size: " field
+    uint64_t length;     // Header bytes consumed, newline included once done
+    bool done;
+} LegacyParser;
+
+void legacyParserInit(LegacyParser *parser);
+
+// Parses up to length more header bytes, calling onEntry for every entry
+// completed. Returns the number of bytes consumed: all of them, or fewer
+// if the header ends (parser->done) inside the piece, in which case the
+// rest is member data. Returns -1 on a malformed header.
+ssize_t legacyParse(LegacyParser *parser, const char *data, size_t length, LegacyEntryFn onEntry, void *context);
+
+// Writes name escaped. Returns the number of bytes written, or -1.
+long legacyWriteName(FILE *file, const char *name, size_t nameLength);
+
+#endif
@@ -0,0 +1,443 @@
+#include "libtarsau.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "lz.h"
+#include "sauformat.h"
+
+struct TarsauArchive {
+    const unsigned char *map;
+    size_t size;
+    SauTrailer trailer;
+};
+
+// Where a member's stored content is and which file ranges it fills
+typedef struct {
+    const unsigned char *encodedExtents;  // NULL for a dense member
+    uint64_t count;
+    uint64_t position;  // First byte of content after the extent map
+    uint64_t end;       // End of the member's stored bytes
+    uint64_t dataSize;  // Sum of the extent lengths
+} MemberLayout;
+
+// Checks that the trailer, TOC and names of a mapped archive are consistent
+// and that every entry points inside the data area, so later calls can trust
+// the TOC. Mirrors readArchiveTrailer and readArchiveToc in tarsau.c.
+static int checkArchive(TarsauArchive *archive) {
+    const unsigned char *map = archive->map;
+    uint64_t size = archive->size;
+    SauTrailer *trailer = &archive->trailer;
+
+    if (size >= 6 && memcmp(map, "Size: ", 6) == 0) {
+        return TARSAU_ERR_VERSION;
+    }
+    if (size < SAU_FILE_HEADER_SIZE + SAU_TOC_HEADER_SIZE + SAU_TRAILER_SIZE ||
+        memcmp(map, SAU_FILE_MAGIC, SAU_MAGIC_SIZE) != 0) {
+        return TARSAU_ERR_FORMAT;
+    }
+
+    // The last trailer whose TOC is in front of it; only an update cut
+    // short leaves anything after it
+    uint64_t trailerOffset = size - SAU_TRAILER_SIZE;
+    while (sauDecodeTrailer(map + trailerOffset, trailer) == -1 || sauCheckTrailer(trailer, trailerOffset) == -1 ||
+           memcmp(map + trailer->tocOffset, SAU_TOC_MAGIC, SAU_MAGIC_SIZE) != 0) {
+        if (trailerOffset == 0) {
+            return TARSAU_ERR_FORMAT;
+        }
+        trailerOffset--;
+    }
+
+    const unsigned char *tocHeader = map + trailer->tocOffset;
+    if (sauGetU32(tocHeader + 4) != SAU_TOC_ENTRY_SIZE ||
+        sauGetU64(tocHeader + 8) != trailer->entryCount) {
+        return TARSAU_ERR_FORMAT;
+    }
+
+    // sauCheckTrailer already tiles these, but the names are read straight
+    // out of the mapping, so bound them here too rather than trust it
+    if (trailer->namesOffset > trailerOffset || trailer->namesLength > trailerOffset - trailer->namesOffset) {
+        return TARSAU_ERR_FORMAT;
+    }
+
+    const char *names = (const char *)map + trailer->namesOffset;
+    for (uint64_t i = 0; i < trailer->entryCount; i++) {
+        SauTocEntry entry;
+        sauDecodeTocEntry(tocHeader + SAU_TOC_HEADER_SIZE + i * SAU_TOC_ENTRY_SIZE, &entry);
+        if (entry.nameOffset >= trailer->namesLength ||
+            entry.nameLength >= trailer->namesLength - entry.nameOffset ||
+            entry.nameOffset + entry.nameLength >= size - trailer->namesOffset ||
+            names[entry.nameOffset + entry.nameLength] != '\0' ||
+            entry.offset > trailer->tocOffset ||
+            entry.storedSize > trailer->tocOffset - entry.offset) {
+            return TARSAU_ERR_FORMAT;
+        }
+    }
+    return TARSAU_OK;
+}
+
+int tarsauOpen(const char *path, TarsauArchive **archive) {
+    *archive = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return TARSAU_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int savedErrno = errno;
+        close(fd);
+        errno = savedErrno;
+        return TARSAU_ERR_IO;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return TARSAU_ERR_FORMAT;
+    }
+
+    TarsauArchive *opened = calloc(1, sizeof(TarsauArchive));
+    if (!opened) {
+        close(fd);
+        return TARSAU_ERR_NOMEM;
+    }
+    opened->size = st.st_size;
+    void *map = mmap(NULL, opened->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int savedErrno = errno;
+    close(fd);  // The mapping keeps the file
+    if (map == MAP_FAILED) {
+        free(opened);
+        errno = savedErrno;
+        return TARSAU_ERR_IO;
+    }
+    opened->map = map;
+
+    int result = checkArchive(opened);
+    if (result != TARSAU_OK) {
+        tarsauClose(opened);
+        return result;
+    }
+    *archive = opened;
+    return TARSAU_OK;
+}
+
+void tarsauClose(TarsauArchive *archive) {
+    if (!archive) {
+        return;
+    }
+    munmap((void *)archive->map, archive->size);
+    free(archive);
+}
+
+uint64_t tarsauCount(const TarsauArchive *archive) {
+    return archive->trailer.entryCount;
+}
+
+int tarsauMember(const TarsauArchive *archive, uint64_t index, TarsauMember *member) {
+    if (index >= archive->trailer.entryCount) {
+        return TARSAU_ERR_RANGE;
+    }
+    SauTocEntry entry;
+    sauDecodeTocEntry(archive->map + archive->trailer.tocOffset + SAU_TOC_HEADER_SIZE + index * SAU_TOC_ENTRY_SIZE,
+                      &entry);
+    member->name = (const char *)archive->map + archive->trailer.namesOffset + entry.nameOffset;
+    member->nameLength = entry.nameLength;
+    member->mode = entry.mode;
+    member->size = entry.size;
+    member->storedSize = entry.storedSize;
+    member->flags = entry.flags;
+    member->checksum = entry.checksum;
+    member->index = index;
+    member->offset = entry.offset;
+    return TARSAU_OK;
+}
+
+int tarsauNext(const TarsauArchive *archive, uint64_t *cursor, TarsauMember *member) {
+    if (*cursor >= archive->trailer.entryCount) {
+        return TARSAU_END;
+    }
+    return tarsauMember(archive, (*cursor)++, member);
+}
+
+int tarsauFind(const TarsauArchive *archive, const char *name, TarsauMember *member) {
+    const SauTrailer *trailer = &archive->trailer;
+    size_t nameLength = strlen(name);
+
+    // Archives without an index are searched in TOC order
+    if (trailer->indexSlots == 0) {
+        for (uint64_t i = 0; i < trailer->entryCount; i++) {
+            tarsauMember(archive, i, member);
+            if (member->nameLength == nameLength && memcmp(member->name, name, nameLength) == 0) {
+                return TARSAU_OK;
+            }
+        }
+        return TARSAU_ERR_NOT_FOUND;
+    }
+
+    uint64_t hash = sauHashName(name, nameLength);
+    uint64_t mask = trailer->indexSlots - 1;
+    uint64_t slot = hash & mask;
+    for (uint64_t probed = 0; probed < trailer->indexSlots; probed++, slot = (slot + 1) & mask) {
+        const unsigned char *encoded = archive->map + trailer->indexOffset + slot * SAU_INDEX_SLOT_SIZE;
+        uint64_t entryIndex = sauGetU64(encoded + 8);
+        if (entryIndex == 0) {
+            break;
+        }
+        if (sauGetU64(encoded) != hash || entryIndex > trailer->entryCount) {
+            continue;
+        }
+        tarsauMember(archive, entryIndex - 1, member);
+        if (member->nameLength == nameLength && memcmp(member->name, name, nameLength) == 0) {
+            return TARSAU_OK;
+        }
+    }
+    return TARSAU_ERR_NOT_FOUND;
+}
+
+// Locates the stored content of a member and checks its extent map. The
+// member is checked against the archive again, since callers may pass a
+// TarsauMember they filled in themselves.
+static int layoutMember(const TarsauArchive *archive, const TarsauMember *member, MemberLayout *layout) {
+    uint64_t dataEnd = archive->trailer.tocOffset;
+    if (member->offset < SAU_FILE_HEADER_SIZE || member->offset > dataEnd ||
+        member->storedSize > dataEnd - member->offset) {
+        return TARSAU_ERR_FORMAT;
+    }
+    layout->encodedExtents = NULL;
+    layout->count = 1;
+    layout->position = member->offset;
+    layout->end = member->offset + member->storedSize;
+    layout->dataSize = member->size;
+    if (!(member->flags & TARSAU_MEMBER_SPARSE)) {
+        return TARSAU_OK;
+    }
+
+    if (member->storedSize < SAU_EXTENT_COUNT_SIZE) {
+        return TARSAU_ERR_FORMAT;
+    }
+    uint64_t count = sauGetU64(archive->map + member->offset);
+    if (count > (member->storedSize - SAU_EXTENT_COUNT_SIZE) / SAU_EXTENT_SIZE) {
+        return TARSAU_ERR_FORMAT;
+    }
+    layout->encodedExtents = archive->map + member->offset + SAU_EXTENT_COUNT_SIZE;
+    layout->count = count;
+    layout->position += SAU_EXTENT_COUNT_SIZE + count * SAU_EXTENT_SIZE;
+    layout->dataSize = 0;
+
+    uint64_t end = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        SauExtent extent;
+        sauDecodeExtent(layout->encodedExtents + i * SAU_EXTENT_SIZE, &extent);
+        if (extent.length == 0 || extent.offset < end || extent.offset > member->size ||
+            extent.length > member->size - extent.offset) {
+            return TARSAU_ERR_FORMAT;
+        }
+        end = extent.offset + extent.length;
+        layout->dataSize += extent.length;
+    }
+    return TARSAU_OK;
+}
+
+static void layoutExtent(const MemberLayout *layout, const TarsauMember *member, uint64_t index, SauExtent *extent) {
+    if (layout->encodedExtents) {
+        sauDecodeExtent(layout->encodedExtents + index * SAU_EXTENT_SIZE, extent);
+    } else {
+        extent->offset = 0;
+        extent->length = member->size;
+    }
+}
+
+int tarsauView(const TarsauArchive *archive, const TarsauMember *member, const void **data, size_t *length) {
+    if (member->flags & (TARSAU_MEMBER_COMPRESSED | TARSAU_MEMBER_DEDUP | TARSAU_MEMBER_SPARSE)) {
+        return TARSAU_ERR_NOT_CONTIGUOUS;
+    }
+    MemberLayout layout;
+    int result = layoutMember(archive, member, &layout);
+    if (result != TARSAU_OK) {
+        return result;
+    }
+    if (member->storedSize != member->size) {
+        return TARSAU_ERR_FORMAT;
+    }
+    *data = archive->map + member->offset;
+    *length = member->size;
+    return TARSAU_OK;
+}
+
+int tarsauWalk(const TarsauArchive *archive, const TarsauMember *member, TarsauVisit visit, void *context) {
+    const unsigned char *map = archive->map;
+    MemberLayout layout;
+    int result = layoutMember(archive, member, &layout);
+    if (result != TARSAU_OK) {
+        return result;
+    }
+    uint64_t position = layout.position;
+    uint64_t end = layout.end;
+
+    // Plain content is the extents back to back
+    if (!(member->flags & (TARSAU_MEMBER_COMPRESSED | TARSAU_MEMBER_DEDUP))) {
+        if (end - position != layout.dataSize) {
+            return TARSAU_ERR_FORMAT;
+        }
+        for (uint64_t i = 0; i < layout.count && layout.dataSize > 0; i++) {
+            SauExtent extent;
+            layoutExtent(&layout, member, i, &extent);
+            // Extents larger than the address space are handed over in pieces
+            for (uint64_t done = 0; done < extent.length; ) {
+                uint64_t piece = extent.length - done < SIZE_MAX ? extent.length - done : SIZE_MAX;
+                result = visit(context, extent.offset + done, map + position, piece);
+                if (result != TARSAU_OK) {
+                    return result;
+                }
+                position += piece;
+                done += piece;
+            }
+        }
+        return TARSAU_OK;
+    }
+
+    unsigned char *raw = NULL;
+    if (member->flags & TARSAU_MEMBER_COMPRESSED) {
+        raw = malloc(SAU_MAX_BLOCK_SIZE);
+        if (!raw) {
+            return TARSAU_ERR_NOMEM;
+        }
+    }
+
+    uint64_t walked = 0;
+    uint64_t extentIndex = 0;
+    uint64_t extentEnd = 0;  // Walked bytes up to the end of the current extent
+    SauExtent extent = {0, 0};
+    result = TARSAU_OK;
+    while (walked < layout.dataSize) {
+        if (walked == extentEnd) {
+            layoutExtent(&layout, member, extentIndex++, &extent);
+            extentEnd += extent.length;
+        }
+        const void *data;
+        uint32_t length;
+        if (member->flags & TARSAU_MEMBER_DEDUP) {
+            if (end - position < SAU_CHUNK_HEADER_SIZE) {
+                break;
+            }
+            length = sauGetU32(map + position);
+            uint64_t source = sauGetU64(map + position + 4);
+            position += SAU_CHUNK_HEADER_SIZE;
+            if (length == 0 || length > extentEnd - walked) {
+                break;
+            }
+            if (source == 0) {
+                if (length > end - position) {
+                    break;
+                }
+                source = position;
+                position += length;
+            } else if (source < SAU_FILE_HEADER_SIZE || source >= position ||
+                       length > archive->trailer.tocOffset - source) {
+                break;  // References only ever point backwards
+            }
+            data = map + source;
+        } else {
+            if (end - position < SAU_BLOCK_HEADER_SIZE) {
+                break;
+            }
+            length = sauGetU32(map + position);
+            uint32_t storedLength = sauGetU32(map + position + 4);
+            position += SAU_BLOCK_HEADER_SIZE;
+            if (length == 0 || length > SAU_MAX_BLOCK_SIZE || storedLength > length ||
+                storedLength > end - position || length > extentEnd - walked) {
+                break;
+            }
+            data = map + position;
+            if (storedLength < length) {
+                if (lzDecompress(map + position, storedLength, raw, length) == -1) {
+                    break;
+                }
+                data = raw;
+            }
+            position += storedLength;
+        }
+        result = visit(context, extent.offset + extent.length - (extentEnd - walked), data, length);
+        if (result != TARSAU_OK) {
+            break;
+        }
+        walked += length;
+    }
+
+    free(raw);
+    if (result != TARSAU_OK) {
+        return result;
+    }
+    if (walked != layout.dataSize || position != end) {
+        return TARSAU_ERR_FORMAT;  // Malformed or truncated member
+    }
+    return TARSAU_OK;
+}
+
+static int copyVisit(void *context, uint64_t offset, const void *data, size_t length) {
+    memcpy((unsigned char *)context + offset, data, length);
+    return TARSAU_OK;
+}
+
+int tarsauExtract(const TarsauArchive *archive, const TarsauMember *member, void *buffer, size_t capacity) {
+    if (member->size > capacity) {
+        return TARSAU_ERR_RANGE;
+    }
+    // Holes are never visited
+    if (member->flags & TARSAU_MEMBER_SPARSE) {
+        memset(buffer, 0, member->size);
+    }
+    return tarsauWalk(archive, member, copyVisit, buffer);
+}
+
+static int checksumVisit(void *context, uint64_t offset, const void *data, size_t length) {
+    uint32_t *crc = context;
+    *crc = crc32c(*crc, data, length);
+    return TARSAU_OK;
+}
+
+int tarsauVerify(const TarsauArchive *archive, const TarsauMember *member) {
+    if (!(member->flags & TARSAU_MEMBER_CHECKSUM)) {
+        return TARSAU_ERR_NO_CHECKSUM;
+    }
+    uint32_t crc = 0;
+    int result = tarsauWalk(archive, member, checksumVisit, &crc);
+    if (result != TARSAU_OK) {
+        return result;
+    }
+    return crc == member->checksum ? TARSAU_OK : TARSAU_ERR_CHECKSUM;
+}
+
+const char *tarsauError(int error) {
+    switch (error) {
+    case TARSAU_OK:
+        return "success";
+    case TARSAU_END:
+        return "no more members";
+    case TARSAU_ERR_IO:
+        return "cannot read the archive";
+    case TARSAU_ERR_NOMEM:
+        return "out of memory";
+    case TARSAU_ERR_FORMAT:
+        return "malformed archive";
+    case TARSAU_ERR_VERSION:
+        return "version 1 archives are not supported";
+    case TARSAU_ERR_NOT_FOUND:
+        return "no such member";
+    case TARSAU_ERR_NOT_CONTIGUOUS:
+        return "member is not stored contiguously";
+    case TARSAU_ERR_RANGE:
+        return "out of range";
+    case TARSAU_ERR_CHECKSUM:
+        return "checksum mismatch";
+    case TARSAU_ERR_NO_CHECKSUM:
+        return "member has no checksum";
+    default:
+        return "unknown error";
+    }
+}
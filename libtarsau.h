@@ -0,0 +1,96 @@
+#ifndef LIBTARSAU_H
+#define LIBTARSAU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only access to version 2 .sau archives from inside another program.
+// tarsauOpen maps the archive and checks its trailer, TOC and names once;
+// after that members are listed, looked up through the archive's name index
+// and read straight out of the mapping. Nothing here exits or prints: every
+// call returns TARSAU_OK or one of the negative codes below. An open
+// archive is never modified, so any number of threads may use it at once.
+//
+// Build with `make lib` and link against libtarsau.a.
+
+enum {
+    TARSAU_OK = 0,
+    TARSAU_END = 1,                   // tarsauNext: no members left
+    TARSAU_ERR_IO = -1,               // open, fstat or mmap failed; see errno
+    TARSAU_ERR_NOMEM = -2,
+    TARSAU_ERR_FORMAT = -3,           // Not a .sau archive, or a malformed one
+    TARSAU_ERR_VERSION = -4,          // A version 1 (text header) archive
+    TARSAU_ERR_NOT_FOUND = -5,
+    TARSAU_ERR_NOT_CONTIGUOUS = -6,   // tarsauView of a member not stored as is
+    TARSAU_ERR_RANGE = -7,            // Index past the end, or buffer too small
+    TARSAU_ERR_CHECKSUM = -8,         // Content does not match the stored CRC-32C
+    TARSAU_ERR_NO_CHECKSUM = -9       // Member was archived without a checksum
+};
+
+// Member flags, as stored in the archive
+#define TARSAU_MEMBER_COMPRESSED 0x1
+#define TARSAU_MEMBER_DEDUP 0x2
+#define TARSAU_MEMBER_CHECKSUM 0x4
+#define TARSAU_MEMBER_SPARSE 0x8
+
+typedef struct TarsauArchive TarsauArchive;
+
+// One member. The name points into the mapping and stays valid until
+// tarsauClose.
+typedef struct {
+    const char *name;     // NUL-terminated
+    uint32_t nameLength;
+    uint32_t mode;        // Permission bits
+    uint64_t size;        // Size once extracted
+    uint64_t storedSize;  // Bytes the member takes in the archive
+    uint32_t flags;       // TARSAU_MEMBER_*
+    uint32_t checksum;    // CRC-32C of the content, with TARSAU_MEMBER_CHECKSUM
+    uint64_t index;       // Position in the TOC
+    uint64_t offset;      // Where the member data starts in the archive
+} TarsauMember;
+
+// Called by tarsauWalk for each run of member content, in order: length
+// bytes that belong at offset in the extracted file. Returning anything
+// but TARSAU_OK stops the walk with that value.
+typedef int (*TarsauVisit)(void *context, uint64_t offset, const void *data, size_t length);
+
+int tarsauOpen(const char *path, TarsauArchive **archive);
+
+void tarsauClose(TarsauArchive *archive);
+
+// Number of members, i.e. TOC entries
+uint64_t tarsauCount(const TarsauArchive *archive);
+
+// Member at a TOC position, TARSAU_ERR_RANGE past the end
+int tarsauMember(const TarsauArchive *archive, uint64_t index, TarsauMember *member);
+
+// Iterates over the members in archive order. Start with *cursor = 0;
+// returns TARSAU_OK for each member and then TARSAU_END.
+int tarsauNext(const TarsauArchive *archive, uint64_t *cursor, TarsauMember *member);
+
+// Looks a member up by its archive name through the name index, reading a
+// few index slots and names rather than the whole TOC
+int tarsauFind(const TarsauArchive *archive, const char *name, TarsauMember *member);
+
+// Points *data at the content of a member stored as is (not compressed,
+// deduplicated or sparse), inside the mapping: no copy is made.
+// TARSAU_ERR_NOT_CONTIGUOUS for the other members; see tarsauWalk.
+int tarsauView(const TarsauArchive *archive, const TarsauMember *member, const void **data, size_t *length);
+
+// Hands the content of any member to visit as runs of bytes. Plain data,
+// deduplicated chunks and sparse extents point into the mapping; compressed
+// blocks are decoded into a buffer that is only valid during the call.
+// Holes of a sparse member are skipped (they read as zeros).
+int tarsauWalk(const TarsauArchive *archive, const TarsauMember *member, TarsauVisit visit, void *context);
+
+// Copies the content of a member into buffer, which must hold member->size
+// bytes (TARSAU_ERR_RANGE otherwise)
+int tarsauExtract(const TarsauArchive *archive, const TarsauMember *member, void *buffer, size_t capacity);
+
+// Checks the content of a member against its stored CRC-32C
+int tarsauVerify(const TarsauArchive *archive, const TarsauMember *member);
+
+// Message for a TARSAU_* code
+const char *tarsauError(int error);
+
+#endif
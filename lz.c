@@ -0,0 +1,171 @@
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5   // The block always ends with this many literals
+#define LZ_MATCH_LIMIT 12    // No match may start closer than this to the end
+
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash32(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes the 255-run encoding of a length that did not fit in the token
+static inline unsigned char *writeLength(unsigned char *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+static unsigned char *writeSequence(unsigned char *op, unsigned char *end, const unsigned char *literals,
+                                    size_t literalLength, size_t offset, size_t matchLength) {
+    // Token, length bytes, literals and offset must all fit
+    if ((size_t)(end - op) < 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1) {
+        return NULL;
+    }
+
+    unsigned char *token = op++;
+    *token = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+    if (literalLength >= 15) {
+        op = writeLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    if (matchLength == 0) {
+        return op;  // Final literal-only sequence
+    }
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    matchLength -= LZ_MIN_MATCH;
+    *token |= (unsigned char)(matchLength < 15 ? matchLength : 15);
+    if (matchLength >= 15) {
+        op = writeLength(op, matchLength - 15);
+    }
+    return op;
+}
+
+size_t lzCompress(const void *src, size_t length, void *dst, size_t capacity) {
+    const unsigned char *input = src;
+    unsigned char *op = dst;
+    unsigned char *end = op + capacity;
+    uint32_t table[1 << LZ_HASH_BITS];
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    memset(table, 0, sizeof(table));
+
+    if (length > LZ_MATCH_LIMIT) {
+        size_t matchLimit = length - LZ_MATCH_LIMIT;
+        unsigned misses = 0;
+
+        while (ip < matchLimit) {
+            uint32_t sequence = read32(input + ip);
+            uint32_t hash = hash32(sequence);
+            size_t candidate = table[hash];
+            table[hash] = (uint32_t)ip;
+
+            if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET || read32(input + candidate) != sequence) {
+                // Skip ahead faster through data that does not compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            size_t matchLength = LZ_MIN_MATCH;
+            while (ip + matchLength < length - LZ_LAST_LITERALS &&
+                   input[candidate + matchLength] == input[ip + matchLength]) {
+                matchLength++;
+            }
+
+            op = writeSequence(op, end, input + anchor, ip - anchor, ip - candidate, matchLength);
+            if (!op) {
+                return 0;
+            }
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    op = writeSequence(op, end, input + anchor, length - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return (size_t)(op - (unsigned char *)dst);
+}
+
+// Reads a 255-run length continuation; returns -1 past the end of input
+static inline int readLength(const unsigned char *input, size_t length, size_t *ip, size_t *value) {
+    unsigned char byte;
+    do {
+        if (*ip >= length) {
+            return -1;
+        }
+        byte = input[(*ip)++];
+        *value += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int lzDecompress(const void *src, size_t length, void *dst, size_t rawLength) {
+    const unsigned char *input = src;
+    unsigned char *output = dst;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < length) {
+        unsigned char token = input[ip++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && readLength(input, length, &ip, &literalLength) == -1) {
+            return -1;
+        }
+        if (literalLength > length - ip || literalLength > rawLength - op) {
+            return -1;
+        }
+        memcpy(output + op, input + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == length) {
+            break;  // The last sequence has no match part
+        }
+
+        if (length - ip < 2) {
+            return -1;
+        }
+        size_t offset = input[ip] | (size_t)input[ip + 1] << 8;
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && readLength(input, length, &ip, &matchLength) == -1) {
+            return -1;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || matchLength > rawLength - op) {
+            return -1;
+        }
+
+        if (offset >= matchLength) {
+            memcpy(output + op, output + op - offset, matchLength);
+            op += matchLength;
+        } else {
+            // Overlapping copy repeats the last `offset` bytes
+            for (size_t i = 0; i < matchLength; i++, op++) {
+                output[op] = output[op - offset];
+            }
+        }
+    }
+    return op == rawLength ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+// A small LZ77 block codec in the style of LZ4: byte-aligned sequences of
+// literals plus (offset, length) back-references within a 64 KiB window.
+// Every block is compressed independently, so blocks can be handled on
+// different threads.
+
+// Worst-case compressed size for `length` input bytes
+#define LZ_COMPRESS_BOUND(length) ((length) + (length) / 255 + 16)
+
+// Compresses `length` bytes into dst (capacity bytes). Returns the
+// compressed size, or 0 if the output would not fit.
+size_t lzCompress(const void *src, size_t length, void *dst, size_t capacity);
+
+// Decompresses a block produced by lzCompress. Returns 0 if it decodes to
+// exactly rawLength bytes and -1 if the input is malformed.
+int lzDecompress(const void *src, size_t length, void *dst, size_t rawLength);
+
+#endif
@@ -0,0 +1,77 @@
+#include "members.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMBERS_INITIAL_CAPACITY 64
+#define NAMES_INITIAL_CAPACITY 4096
+
+// Length of the leading "/", "./" and "../" components of name
+static size_t archiveNamePrefix(const char *name, size_t nameLength) {
+    size_t prefix = 0;
+    for (;;) {
+        if (prefix < nameLength && name[prefix] == '/') {
+            prefix++;
+        } else if (nameLength - prefix >= 2 && memcmp(name + prefix, "./", 2) == 0) {
+            prefix += 2;
+        } else if (nameLength - prefix >= 3 && memcmp(name + prefix, "../", 3) == 0) {
+            prefix += 3;
+        } else {
+            return prefix;
+        }
+    }
+}
+
+FileInfo *memberListAdd(MemberList *list, const char *name, size_t nameLength) {
+    if (list->count == list->capacity) {
+        uint64_t capacity = list->capacity ? 2 * list->capacity : MEMBERS_INITIAL_CAPACITY;
+        FileInfo *members = realloc(list->members, capacity * sizeof(FileInfo));
+        if (!members) {
+            return NULL;
+        }
+        list->members = members;
+        list->capacity = capacity;
+    }
+    if (list->namesLength + nameLength + 1 > list->namesCapacity) {
+        uint64_t capacity = list->namesCapacity ? list->namesCapacity : NAMES_INITIAL_CAPACITY;
+        while (list->namesLength + nameLength + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *names = realloc(list->names, capacity);
+        if (!names) {
+            return NULL;
+        }
+        list->names = names;
+        list->namesCapacity = capacity;
+    }
+
+    FileInfo *member = &list->members[list->count++];
+    memset(member, 0, sizeof(*member));
+    member->nameOffset = list->namesLength;
+    member->nameLength = nameLength;
+    member->namePrefix = archiveNamePrefix(name, nameLength);
+    memcpy(list->names + list->namesLength, name, nameLength);
+    list->names[list->namesLength + nameLength] = '\0';
+    list->namesLength += nameLength + 1;
+    return member;
+}
+
+int memberListAppend(MemberList *list, const MemberList *other) {
+    for (uint64_t i = 0; i < other->count; i++) {
+        const FileInfo *source = &other->members[i];
+        FileInfo *member = memberListAdd(list, memberName(other, source), source->nameLength);
+        if (!member) {
+            return -1;
+        }
+        uint64_t nameOffset = member->nameOffset;
+        *member = *source;
+        member->nameOffset = nameOffset;
+    }
+    return 0;
+}
+
+void memberListFree(MemberList *list) {
+    free(list->members);
+    free(list->names);
+    memset(list, 0, sizeof(*list));
+}
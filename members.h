@@ -0,0 +1,60 @@
+#ifndef MEMBERS_H
+#define MEMBERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Metadata of one archive member. Names are not stored in the record but
+// interned into the arena of the MemberList that owns it. The name is the
+// path the input is opened by; the archive keeps it without any leading
+// "/", "./" or "../" components, so members always extract below the
+// target directory.
+typedef struct {
+    uint64_t nameOffset;  // Offset of the NUL-terminated name in the arena
+    uint64_t size;
+    uint64_t offset;      // Where the member data starts in the archive
+    uint64_t storedSize;  // Bytes the member takes in the archive
+    uint32_t nameLength;  // Without the terminating NUL
+    uint32_t namePrefix;  // Leading bytes of the name left out of the archive
+    uint32_t mode;        // Permission bits
+    uint32_t flags;       // SAU_MEMBER_* flags
+    uint32_t checksum;    // CRC-32C of the content, with SAU_MEMBER_CHECKSUM
+} FileInfo;
+
+// Growable member table. Records and names each live in a single
+// allocation that doubles when full, so a member costs sizeof(FileInfo)
+// plus its name and adding one is amortised O(1). Both arrays may move when
+// a member is added: keep indices and name offsets, not pointers.
+typedef struct {
+    FileInfo *members;
+    uint64_t count;
+    uint64_t capacity;
+    char *names;
+    uint64_t namesLength;
+    uint64_t namesCapacity;
+} MemberList;
+
+// Appends a member with every field but the name zeroed and returns it,
+// or NULL if memory runs out. An empty list needs no initialisation
+// beyond being zeroed.
+FileInfo *memberListAdd(MemberList *list, const char *name, size_t nameLength);
+
+// Appends copies of every member of other. Returns -1 if memory runs out.
+int memberListAppend(MemberList *list, const MemberList *other);
+
+void memberListFree(MemberList *list);
+
+static inline const char *memberName(const MemberList *list, const FileInfo *member) {
+    return list->names + member->nameOffset;
+}
+
+// The name as it is stored in the archive
+static inline const char *memberArchiveName(const MemberList *list, const FileInfo *member) {
+    return list->names + member->nameOffset + member->namePrefix;
+}
+
+static inline uint32_t memberArchiveNameLength(const FileInfo *member) {
+    return member->nameLength - member->namePrefix;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    ParallelTask task;
+    void *context;
+    uint64_t numTasks;
+    atomic_uint_fast64_t nextTask;
+} ParallelJob;
+
+static void *parallelWorker(void *argument) {
+    ParallelJob *job = argument;
+    uint64_t taskIndex;
+    while ((taskIndex = atomic_fetch_add(&job->nextTask, 1)) < job->numTasks) {
+        job->task(taskIndex, job->context);
+    }
+    return NULL;
+}
+
+void runParallel(int numThreads, uint64_t numTasks, ParallelTask task, void *context) {
+    ParallelJob job = {task, context, numTasks, 0};
+
+    if (numThreads > 1 && (uint64_t)numThreads > numTasks) {
+        numThreads = (int)numTasks;
+    }
+    if (numThreads <= 1) {
+        parallelWorker(&job);
+        return;
+    }
+
+    // The calling thread works too, so start one thread fewer
+    pthread_t *threads = malloc((numThreads - 1) * sizeof(pthread_t));
+    int started = 0;
+    if (threads) {
+        while (started < numThreads - 1 &&
+               pthread_create(&threads[started], NULL, parallelWorker, &job) == 0) {
+            started++;
+        }
+    }
+    parallelWorker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+int onlineCpuCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
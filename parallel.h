@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+typedef void (*ParallelTask)(uint64_t taskIndex, void *context);
+
+// Runs task(i, context) for every i in [0, numTasks) on up to numThreads
+// threads and returns once all of them have finished. Tasks are handed out
+// one at a time from a shared counter, so uneven task sizes balance out.
+// With numThreads <= 1 everything runs on the calling thread, in order.
+void runParallel(int numThreads, uint64_t numTasks, ParallelTask task, void *context);
+
+// Number of online CPUs, at least 1
+int onlineCpuCount(void);
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef SAUFORMAT_H
+#define SAUFORMAT_H
+
+// On-disk layout of version 2 .sau archives. All integers are little-endian.
+//
+//   file header    "SAU2" | u32 version | u64 flags
+//   member record  "SAUM" | u32 nameLength | u32 mode | u32 flags | u64 size
+//                  followed by the name bytes and then the member data,
+//                  repeated once per member
+//   TOC            "SAUT" | u32 entrySize | u64 entryCount
+//                  followed by entryCount fixed-width entries and the names
+//                  blob (every name NUL-terminated)
+//   name index     indexSlots open-addressing slots of
+//                  u64 nameHash | u64 entryIndex + 1 (0 marks an empty slot)
+//   trailer        u64 tocOffset | u64 entryCount | u64 namesOffset |
+//                  u64 namesLength | u64 indexOffset | u64 indexSlots |
+//                  "SAUE" | u32 version
+//
+// The TOC is written after the data, so an archive is produced in a single
+// forward pass, and the fixed-size trailer at the end of the file locates it.
+// Each TOC entry stores the absolute offset of its member's data, so any
+// member can be reached with one seek. The inline member records keep the
+// archive readable front to back without the TOC. The name index is a hash
+// table with linear probing (indexSlots is a power of two), so looking up one
+// member reads a few slots, one TOC entry and one name.
+//
+// Member names are relative paths separated by '/', never absolute and
+// never containing "..", and extraction recreates the directories in them.
+//
+// An update (-u) appends the new member records after the old trailer,
+// followed by a fresh TOC, index and trailer for all members; nothing already
+// in the file is overwritten. The old TOC, index and trailer stay behind the
+// old members, and a superseded member's data stays in the file, with no TOC
+// entry pointing at either. The old trailer remains intact until the new one
+// is on disk, so readers that find no trailer at the end of the file (an
+// update cut short) fall back to the last intact trailer before it, and
+// front-to-back readers continue past a trailer that is followed by more
+// member records.
+//
+// Members flagged SAU_MEMBER_COMPRESSED are stored as a run of independent
+// blocks, each "u32 rawLength | u32 storedLength" followed by storedLength
+// bytes: LZ-compressed data, or the raw bytes when storedLength equals
+// rawLength, which is at most SAU_MAX_BLOCK_SIZE. The TOC entry keeps both
+// the extracted and the stored size.
+//
+// Members flagged SAU_MEMBER_DEDUP are a run of chunk records
+// "u32 length | u64 sourceOffset". A zero sourceOffset means the chunk's
+// bytes follow the record; otherwise they are the bytes already stored at
+// that absolute archive offset by an earlier chunk.
+//
+// Members flagged SAU_MEMBER_CHECKSUM have the CRC-32C of their extracted
+// content in the checksum field of their TOC entry. It is computed from the
+// blocks the build reads anyway, and -v checks it without extracting.
+//
+// Members flagged SAU_MEMBER_SPARSE had holes. Their data starts with an
+// extent map "u64 extentCount" followed by extentCount entries
+// "u64 offset | u64 length", the data extents of the file in order, disjoint
+// and non-empty. The stored content (plain, blocks or chunks, which never
+// span two extents) is then the bytes of those extents back to back, and
+// everything else in the file is a hole. The member's size is the full file
+// size; its checksum covers the extent bytes only. A map has at most
+// SAU_MAX_EXTENTS entries; files with more are stored dense.
+//
+// Version 1 archives are the original text format: a single line
+// "Size: %010ld|name,perm,size|...\n" followed by the member data.
+
+#include <stdint.h>
+#include <string.h>
+
+#define SAU_VERSION 2
+#define SAU_FILE_MAGIC "SAU2"
+#define SAU_RECORD_MAGIC "SAUM"
+#define SAU_TOC_MAGIC "SAUT"
+#define SAU_TRAILER_MAGIC "SAUE"
+#define SAU_MAGIC_SIZE 4
+
+#define SAU_FILE_HEADER_SIZE 16
+#define SAU_RECORD_HEADER_SIZE 24
+#define SAU_TOC_HEADER_SIZE 16
+#define SAU_TOC_ENTRY_SIZE 48
+#define SAU_TRAILER_SIZE 64
+#define SAU_INDEX_SLOT_SIZE 16
+#define SAU_BLOCK_HEADER_SIZE 8
+#define SAU_CHUNK_HEADER_SIZE 12
+#define SAU_MAX_BLOCK_SIZE (256 * 1024)
+#define SAU_EXTENT_COUNT_SIZE 8
+#define SAU_EXTENT_SIZE 16
+#define SAU_MAX_EXTENTS (1ULL << 24)  // 256 MB of extent map
+
+// Member flags, in both the record header and the TOC entry
+#define SAU_MEMBER_COMPRESSED 0x1
+#define SAU_MEMBER_DEDUP 0x2
+#define SAU_MEMBER_CHECKSUM 0x4
+#define SAU_MEMBER_SPARSE 0x8
+
+// One TOC entry, decoded
+typedef struct {
+    uint64_t offset;      // Absolute offset of the member data
+    uint64_t size;        // Size of the member once extracted
+    uint64_t storedSize;  // Bytes the member occupies in the archive
+    uint64_t nameOffset;  // Offset of the name inside the names blob
+    uint32_t nameLength;  // Name length without the terminating NUL
+    uint32_t mode;        // Permission bits
+    uint32_t flags;
+    uint32_t checksum;    // CRC-32C of the extracted content
+} SauTocEntry;
+
+// One data extent of a sparse member
+typedef struct {
+    uint64_t offset;  // Where the extent starts in the extracted file
+    uint64_t length;
+} SauExtent;
+
+typedef struct {
+    uint64_t tocOffset;
+    uint64_t entryCount;
+    uint64_t namesOffset;
+    uint64_t namesLength;
+    uint64_t indexOffset;
+    uint64_t indexSlots;  // 0 when the archive has no name index
+} SauTrailer;
+
+static inline void sauPutU32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static inline void sauPutU64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static inline uint32_t sauGetU32(const unsigned char *p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static inline uint64_t sauGetU64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static inline void sauEncodeTocEntry(unsigned char *p, const SauTocEntry *entry) {
+    sauPutU64(p, entry->offset);
+    sauPutU64(p + 8, entry->size);
+    sauPutU64(p + 16, entry->storedSize);
+    sauPutU64(p + 24, entry->nameOffset);
+    sauPutU32(p + 32, entry->nameLength);
+    sauPutU32(p + 36, entry->mode);
+    sauPutU32(p + 40, entry->flags);
+    sauPutU32(p + 44, entry->checksum);
+}
+
+static inline void sauDecodeTocEntry(const unsigned char *p, SauTocEntry *entry) {
+    entry->offset = sauGetU64(p);
+    entry->size = sauGetU64(p + 8);
+    entry->storedSize = sauGetU64(p + 16);
+    entry->nameOffset = sauGetU64(p + 24);
+    entry->nameLength = sauGetU32(p + 32);
+    entry->mode = sauGetU32(p + 36);
+    entry->flags = sauGetU32(p + 40);
+    entry->checksum = sauGetU32(p + 44);
+}
+
+static inline void sauEncodeExtent(unsigned char *p, const SauExtent *extent) {
+    sauPutU64(p, extent->offset);
+    sauPutU64(p + 8, extent->length);
+}
+
+static inline void sauDecodeExtent(const unsigned char *p, SauExtent *extent) {
+    extent->offset = sauGetU64(p);
+    extent->length = sauGetU64(p + 8);
+}
+
+static inline void sauEncodeTrailer(unsigned char *p, const SauTrailer *trailer) {
+    memset(p, 0, SAU_TRAILER_SIZE);
+    sauPutU64(p, trailer->tocOffset);
+    sauPutU64(p + 8, trailer->entryCount);
+    sauPutU64(p + 16, trailer->namesOffset);
+    sauPutU64(p + 24, trailer->namesLength);
+    sauPutU64(p + 32, trailer->indexOffset);
+    sauPutU64(p + 40, trailer->indexSlots);
+    memcpy(p + 48, SAU_TRAILER_MAGIC, SAU_MAGIC_SIZE);
+    sauPutU32(p + 52, SAU_VERSION);
+}
+
+// Returns 0 if the trailer magic and version match
+static inline int sauDecodeTrailer(const unsigned char *p, SauTrailer *trailer) {
+    if (memcmp(p + 48, SAU_TRAILER_MAGIC, SAU_MAGIC_SIZE) != 0 || sauGetU32(p + 52) != SAU_VERSION) {
+        return -1;
+    }
+    trailer->tocOffset = sauGetU64(p);
+    trailer->entryCount = sauGetU64(p + 8);
+    trailer->namesOffset = sauGetU64(p + 16);
+    trailer->namesLength = sauGetU64(p + 24);
+    trailer->indexOffset = sauGetU64(p + 32);
+    trailer->indexSlots = sauGetU64(p + 40);
+    return 0;
+}
+
+// Returns 0 if the TOC, names blob and name index described by trailer tile
+// the bytes in front of it, the trailer itself starting at trailerOffset.
+// Every field is compared against what is left of the space, never added to
+// another, so a hostile trailer cannot pass by wrapping around.
+static inline int sauCheckTrailer(const SauTrailer *trailer, uint64_t trailerOffset) {
+    if (trailer->tocOffset < SAU_FILE_HEADER_SIZE || trailer->tocOffset > trailerOffset ||
+        trailerOffset - trailer->tocOffset < SAU_TOC_HEADER_SIZE ||
+        trailer->entryCount > (trailerOffset - trailer->tocOffset - SAU_TOC_HEADER_SIZE) / SAU_TOC_ENTRY_SIZE ||
+        trailer->tocOffset + SAU_TOC_HEADER_SIZE + trailer->entryCount * SAU_TOC_ENTRY_SIZE != trailer->namesOffset ||
+        trailer->indexOffset < trailer->namesOffset || trailer->indexOffset > trailerOffset ||
+        trailer->namesLength != trailer->indexOffset - trailer->namesOffset ||
+        trailer->indexSlots > (trailerOffset - trailer->indexOffset) / SAU_INDEX_SLOT_SIZE ||
+        trailer->indexSlots * SAU_INDEX_SLOT_SIZE != trailerOffset - trailer->indexOffset ||
+        (trailer->indexSlots & (trailer->indexSlots - 1)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// FNV-1a, used to place names in the index
+static inline uint64_t sauHashName(const char *name, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif
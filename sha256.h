@@ -0,0 +1,12 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// One-shot SHA-256 of a buffer
+void sha256(const void *data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+#endif
@@ -0,0 +1,168 @@
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define STATS_MAX_PHASES 8
+
+// Kernel I/O accounting of the whole process (all threads), from
+// /proc/self/io: bytes and calls of read- and write-like syscalls
+typedef struct {
+    uint64_t readBytes;
+    uint64_t writeBytes;
+    uint64_t readCalls;
+    uint64_t writeCalls;
+} StatsIo;
+
+typedef struct {
+    const char *name;
+    double wallSeconds;
+    double cpuSeconds;
+    StatsIo io;
+    uint64_t openCalls;
+} StatsPhase;
+
+bool statsEnabled;
+_Atomic uint64_t statsCounters[STATS_COUNTER_COUNT];
+
+static StatsPhase phases[STATS_MAX_PHASES];
+static int numPhases;
+static int currentPhase = -1;
+static double phaseWallStart;
+static double phaseCpuStart;
+static StatsIo phaseIoStart;
+static uint64_t phaseOpensStart;
+
+static const char *counterNames[STATS_COUNTER_COUNT] = {
+    "open_calls", "stat_calls", "getdents_calls", "open_ns", "scan_bytes", "scan_ns", "compress_ns", "decompress_ns", "hash_ns",
+    "checksum_ns", "cloned_bytes",
+};
+
+static double clockSeconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Leaves io zeroed when /proc/self/io is not available. The counters are
+// taken before the read that returns them is accounted; its length is
+// returned so the caller can include it.
+static ssize_t readProcessIo(StatsIo *io) {
+    char buffer[512];
+    memset(io, 0, sizeof(*io));
+
+    int fd = open("/proc/self/io", O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        return 0;
+    }
+    buffer[length] = '\0';
+
+    for (char *line = buffer; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        char *value = strchr(line, ':');
+        if (!value) {
+            break;
+        }
+        uint64_t number = strtoull(value + 1, NULL, 10);
+        if (strncmp(line, "rchar:", 6) == 0) {
+            io->readBytes = number;
+        } else if (strncmp(line, "wchar:", 6) == 0) {
+            io->writeBytes = number;
+        } else if (strncmp(line, "syscr:", 6) == 0) {
+            io->readCalls = number;
+        } else if (strncmp(line, "syscw:", 6) == 0) {
+            io->writeCalls = number;
+        }
+    }
+    return length;
+}
+
+void statsPhase(const char *name) {
+    if (!statsEnabled) {
+        return;
+    }
+
+    if (currentPhase != -1) {
+        StatsPhase *phase = &phases[currentPhase];
+        StatsIo io;
+        readProcessIo(&io);
+        phase->wallSeconds += clockSeconds(CLOCK_MONOTONIC) - phaseWallStart;
+        phase->cpuSeconds += clockSeconds(CLOCK_PROCESS_CPUTIME_ID) - phaseCpuStart;
+        phase->io.readBytes += io.readBytes - phaseIoStart.readBytes;
+        phase->io.writeBytes += io.writeBytes - phaseIoStart.writeBytes;
+        phase->io.readCalls += io.readCalls - phaseIoStart.readCalls;
+        phase->io.writeCalls += io.writeCalls - phaseIoStart.writeCalls;
+        phase->openCalls += atomic_load(&statsCounters[STATS_OPEN_CALLS]) - phaseOpensStart;
+        currentPhase = -1;
+    }
+    if (!name) {
+        return;
+    }
+
+    // A repeated name adds to the existing phase
+    int index = 0;
+    while (index < numPhases && strcmp(phases[index].name, name) != 0) {
+        index++;
+    }
+    if (index == numPhases) {
+        if (numPhases == STATS_MAX_PHASES) {
+            return;
+        }
+        phases[numPhases++].name = name;
+    }
+    // Start after the read of the counters, so phases do not report the
+    // reads made to measure them
+    ssize_t length = readProcessIo(&phaseIoStart);
+    phaseIoStart.readBytes += length;
+    phaseIoStart.readCalls += length > 0;
+    phaseWallStart = clockSeconds(CLOCK_MONOTONIC);
+    phaseCpuStart = clockSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    phaseOpensStart = atomic_load(&statsCounters[STATS_OPEN_CALLS]);
+    currentPhase = index;
+}
+
+void statsReport(FILE *output, bool json) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    if (json) {
+        fprintf(output, "{\"phases\":[");
+        for (int i = 0; i < numPhases; i++) {
+            const StatsPhase *phase = &phases[i];
+            fprintf(output, "%s{\"name\":\"%s\",\"wall_s\":%.6f,\"cpu_s\":%.6f,\"bytes_read\":%llu,"
+                    "\"bytes_written\":%llu,\"read_calls\":%llu,\"write_calls\":%llu,\"open_calls\":%llu}",
+                    i ? "," : "", phase->name, phase->wallSeconds, phase->cpuSeconds,
+                    (unsigned long long)phase->io.readBytes, (unsigned long long)phase->io.writeBytes,
+                    (unsigned long long)phase->io.readCalls, (unsigned long long)phase->io.writeCalls,
+                    (unsigned long long)phase->openCalls);
+        }
+        fprintf(output, "]");
+        for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+            fprintf(output, ",\"%s\":%llu", counterNames[i], (unsigned long long)atomic_load(&statsCounters[i]));
+        }
+        fprintf(output, ",\"max_rss_kb\":%ld}\n", usage.ru_maxrss);
+        return;
+    }
+
+    fprintf(output, "%-16s %10s %10s %14s %14s %10s %10s %8s\n",
+            "phase", "wall s", "cpu s", "bytes read", "bytes written", "reads", "writes", "opens");
+    for (int i = 0; i < numPhases; i++) {
+        const StatsPhase *phase = &phases[i];
+        fprintf(output, "%-16s %10.6f %10.6f %14llu %14llu %10llu %10llu %8llu\n",
+                phase->name, phase->wallSeconds, phase->cpuSeconds,
+                (unsigned long long)phase->io.readBytes, (unsigned long long)phase->io.writeBytes,
+                (unsigned long long)phase->io.readCalls, (unsigned long long)phase->io.writeCalls,
+                (unsigned long long)phase->openCalls);
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        fprintf(output, "%-16s %llu\n", counterNames[i], (unsigned long long)atomic_load(&statsCounters[i]));
+    }
+    fprintf(output, "%-16s %ld\n", "max_rss_kb", usage.ru_maxrss);
+}
@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Work counters, summed over all threads. The call counters are always
+// maintained (one relaxed atomic add each); the *_NS timers only run with
+// --stats, since they cost two clock reads per measured step.
+typedef enum {
+    STATS_OPEN_CALLS,
+    STATS_STAT_CALLS,
+    STATS_GETDENTS_CALLS,
+    STATS_OPEN_NS,        // Opening and stat'ing inputs, creating outputs
+    STATS_SCAN_BYTES,
+    STATS_SCAN_NS,        // NUL check of build inputs
+    STATS_COMPRESS_NS,
+    STATS_DECOMPRESS_NS,
+    STATS_HASH_NS,        // Chunk digests for deduplication
+    STATS_CHECKSUM_NS,    // CRC-32C of member content
+    STATS_CLONED_BYTES,   // Shared with the previous archive by --cache
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+extern bool statsEnabled;
+extern _Atomic uint64_t statsCounters[STATS_COUNTER_COUNT];
+
+static inline void statsAdd(StatsCounter counter, uint64_t value) {
+    atomic_fetch_add_explicit(&statsCounters[counter], value, memory_order_relaxed);
+}
+
+// Start of a timed step, 0 when timing is off
+static inline uint64_t statsClock(void) {
+    if (!statsEnabled) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void statsAddTime(StatsCounter counter, uint64_t start) {
+    if (statsEnabled) {
+        statsAdd(counter, statsClock() - start);
+    }
+}
+
+// Ends the current phase and starts the named one; NULL only ends it.
+// Phases are sequential steps of the main thread.
+void statsPhase(const char *name);
+
+// Prints every phase with its wall and CPU time and I/O, the work counters
+// and the peak RSS, as text or as one JSON object
+void statsReport(FILE *output, bool json);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,61 +7,328 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <signal.h>
+#include <stdio_ext.h>
 #include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-#define MAX_FILES 32
-#define MAX_SIZE (200 * 1024 * 1024) // 200 MB
-#define LINE_BUFFER_SIZE 1000
-#define FILENAME_BUFFER_SIZE 256
+#include "binscan.h"
+#include "cache.h"
+#include "crc32c.h"
+#include "dircache.h"
+#include "legacy.h"
+#include "lz.h"
+#include "members.h"
+#include "dedup.h"
+#include "parallel.h"
+#include "sauformat.h"
+#include "stats.h"
+#include "throttle.h"
+#include "uring.h"
+#include "walk.h"
+
+#define MAX_SIZE (200 * 1024 * 1024) // 200 MB, the volume size of --split
+#define LEGACY_READ_SIZE (64 * 1024) // Version 1 header bytes parsed per read
+#define LEGACY_PREFIX_SIZE 6 // "Size: "
 #define CONTENT_BUFFER_SIZE 512
-#define FILEPATH_BUFFER_SIZE 512
+#define COPY_BUFFER_SIZE (256 * 1024) // Reused for every member copy
+#define MAX_COPY_REQUEST (1024 * 1024 * 1024) // Per in-kernel copy call, below the 2 GB the kernel moves at once
+#define TOC_BATCH_ENTRIES 4096 // TOC entries encoded/decoded per I/O call
+#define SLOT_BUFFERS 4 // Read-ahead buffers per build slot
+#define BUILD_EXTRA_SLOTS 16 // Inputs readers may finish ahead of the writer
+#define URING_BATCH 64 // Inputs or members per io_uring round trip
+#define URING_SMALL_FILE (64 * 1024) // Larger files take the blocking path
+#define URING_RANGE (8 * URING_BATCH) // Members per extraction task with io_uring
+#define STREAM_BUFFER_SIZE (1024 * 1024) // Pipe and stdio buffer of -o - and -a -
+#define ARCHIVE_BUFFER_SIZE (256 * 1024) // stdio buffer of archive files being written
+#define BATCH_SIZE (1024 * 1024) // Member bytes gathered per write by the member writer
+#define BATCH_IOVECS 64 // Pieces per write, well below IOV_MAX
+#define BATCH_COPY_LIMIT (64 * 1024) // Shorter blocks are copied into the batch
+#define PREALLOCATE_MIN (64 * 1024) // Smaller extracted files are not preallocated
+
+typedef struct {
+    int numThreads;
+    bool compress;  // -z: store members as LZ-compressed blocks
+    bool dedup;  // -d: store each distinct chunk only once
+    bool ioUring;  // --io-uring: batch the I/O of small inputs
+    bool streaming;  // -o -: the archive goes to a pipe and cannot be rewound
+    uint64_t volumeSize;  // --split: largest volume; 0 writes a single archive
+    bool cache;  // --cache: carry unchanged inputs over from the previous build
+} BuildOptions;
+
+// The previous archive and its sidecar, for --cache
+typedef struct {
+    BuildCache *entries;
+    int archiveFd;  // The previous archive, -1 if there is none
+    CacheKey *keys;  // Stat of every input, compacted along with the inputs
+    uint64_t carried;  // Members copied over rather than read
+} CarryOver;
 
+// Decoded table of contents; version 1 headers are converted to the same form
 typedef struct {
-    char filename[FILENAME_BUFFER_SIZE];
-    char permissions[10];
-    size_t size;
-    char *content;  // Dynamic buffer to store file content
-} FileInfo;
+    SauTocEntry *entries;
+    uint64_t count;
+    char *names;  // Names blob, indexed by SauTocEntry.nameOffset
+} ArchiveToc;
+
+void writeToArchive(MemberList *inputs, const char *outputFileName, const BuildOptions *options);
+
+void writeVolumes(MemberList *inputs, const char *outputFileName, const BuildOptions *options);
+
+void updateArchive(const char *archiveFileName, MemberList *inputs, const BuildOptions *options);
 
-void freeFileInfoContent(FileInfo *fileInfos, int numFiles);
+void writeArchiveMembers(FILE *archiveFile, MemberList *inputs, const BuildOptions *options, CarryOver *carry);
 
-void writeToArchive(FileInfo *fileInfos, int numFiles, const char *outputFileName);
+void writeCachedArchive(MemberList *inputs, const char *outputFileName, const BuildOptions *options);
 
-void processFile(FileInfo *fileInfos, int *numFiles, long *totalSize, const char *filename);
+void finishArchive(FILE *archiveFile, const MemberList *members, const char *archiveFileName, bool truncate,
+                   bool sync);
 
-void extractArchive(const char *archiveFileName,const char *extractDirectory);
+void writeLegacyArchive(MemberList *inputs, const char *outputFileName);
 
-bool isBinary(FILE *file);
+void processFile(MemberList *inputs, uint64_t *totalSize, const char *filename, int numThreads);
+
+void addInputFile(MemberList *inputs, const char *filename);
+
+void addInputPath(MemberList *inputs, const char *path, int numThreads, bool statFiles);
+
+void extractArchive(const char *archiveFileName,const char *extractDirectory, int numThreads, bool ioUring);
+
+void extractStream(int archiveFd, const char *extractDirectory);
+
+void extractVolumes(const char *archiveFileName, uint64_t numVolumes, const char *extractDirectory, int numThreads,
+                    bool ioUring);
+
+uint64_t countVolumes(const char *archiveFileName);
+
+void volumeName(char *buffer, size_t size, const char *archiveFileName, uint64_t volume);
 
 void handleFileError(const char *action, const char *filename);
 
+int copyFileToStream(int inputFd, FILE *outputFile, uint64_t size, bool rejectBinary);
+
+long writeArchiveHeader(FILE *archiveFile, const MemberList *members);
+
+int copyArchiveRange(int archiveFd, off_t offset, int outputFd, uint64_t size);
+
+int writeArchiveToc(FILE *archiveFile, const MemberList *members, bool sync);
+
+int readArchiveTrailer(int archiveFd, SauTrailer *trailer);
+
+int readArchiveToc(int archiveFd, ArchiveToc *toc);
+
+int readLegacyToc(FILE *archiveFile, ArchiveToc *toc);
+
+int loadArchiveToc(FILE *archiveFile, ArchiveToc *toc, bool *isLegacy);
+
+void freeArchiveToc(ArchiveToc *toc);
+
+int findArchiveMember(int archiveFd, const SauTrailer *trailer, const char *name, SauTocEntry *entry);
+
+int extractMember(int archiveFd, const SauTocEntry *entry, int outputFd, int numThreads);
+
+void extractTocMembers(int archiveFd, const ArchiveToc *toc, DirCache *tree, int numThreads, bool ioUring);
+
+void extractSelectedMembers(const char *archiveFileName, char **names, int numNames);
+
+void verifyArchive(const char *archiveFileName, int numThreads);
+
+void listArchive(const char *archiveFileName);
+
+
+static bool statsJson;
+static bool useIoUring;
+
+// Printed on stderr so it never mixes with the listing of -l
+static void printStats(void) {
+    statsPhase(NULL);
+    statsReport(stderr, statsJson);
+}
+
+// Parses a byte count with an optional K, M or G suffix (powers of 1024).
+// Returns 0 if text is not a positive size.
+static uint64_t parseSize(const char *text) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || !isdigit((unsigned char)text[0])) {
+        return 0;
+    }
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+    case 'K':
+        shift = 10;
+        break;
+    case 'M':
+        shift = 20;
+        break;
+    case 'G':
+        shift = 30;
+        break;
+    }
+    if (shift > 0) {
+        end++;
+    }
+    if (*end != '\0' || value > (UINT64_MAX >> shift)) {
+        return 0;
+    }
+    return (uint64_t)value << shift;
+}
+
+// Parses a positive rate such as 20 or 0.5. Returns 0 if text is not one.
+static double parseRate(const char *text) {
+    char *end;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (errno != 0 || end == text || *end != '\0' || !(value > 0)) {
+        return 0;
+    }
+    return value;
+}
+
+// Value of the global option at argv[i], given as "--name=value" or as
+// "--name value"; *length is set to the number of arguments it takes up.
+// Returns NULL if argv[i] is not that option.
+static const char *globalOptionValue(int argc, char *argv[], int i, const char *name, int *length) {
+    size_t nameLength = strlen(name);
+    if (strncmp(argv[i], name, nameLength) != 0) {
+        return NULL;
+    }
+    if (argv[i][nameLength] == '=') {
+        *length = 1;
+        return argv[i] + nameLength + 1;
+    }
+    if (argv[i][nameLength] != '\0') {
+        return NULL;
+    }
+    *length = 2;
+    return i + 1 < argc ? argv[i + 1] : "";
+}
 
 int main(int argc, char *argv[]) {
-    long totalSize=0;
+    uint64_t totalSize = 0;
     char *outputFileName = "a.sau";  // Default output file name
+    double rateLimit = 0;
+    double iopsLimit = 0;
+    bool idleIo = false;
+    bool showProgress = false;
+
+    // --stats[=json], --io-uring and the I/O limits may appear anywhere;
+    // drop them before the commands parse
+    for (int i = 1; i < argc; i++) {
+        int length = 1;
+        const char *value;
+        if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=json") == 0) {
+            statsEnabled = true;
+            statsJson = strcmp(argv[i], "--stats=json") == 0;
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            useIoUring = true;
+        } else if (strcmp(argv[i], "--idle-io") == 0) {
+            idleIo = true;
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            showProgress = true;
+        } else if ((value = globalOptionValue(argc, argv, i, "--rate-limit", &length)) != NULL) {
+            rateLimit = parseRate(value);
+            if (rateLimit == 0) {
+                printf("Invalid rate limit: %s\n", value);
+                return EXIT_FAILURE;
+            }
+        } else if ((value = globalOptionValue(argc, argv, i, "--iops-limit", &length)) != NULL) {
+            iopsLimit = parseRate(value);
+            if (iopsLimit == 0) {
+                printf("Invalid IOPS limit: %s\n", value);
+                return EXIT_FAILURE;
+            }
+        } else {
+            continue;
+        }
+        memmove(&argv[i], &argv[i + length], (argc - i - length + 1) * sizeof(char *));
+        argc -= length;
+        i--;
+    }
+    if (statsEnabled) {
+        atexit(printStats);  // Also reports runs that end in exit()
+        statsPhase("setup");
+    }
+    // Before any thread starts, so they all inherit the class
+    if (idleIo && throttleIdlePriority() == -1) {
+        perror("Cannot set the idle I/O priority");
+    }
+    throttleSetLimits(rateLimit * 1024 * 1024, iopsLimit);
+    if (showProgress) {
+        throttleStartProgress();
+    }
 
-    if (argc < 3 || (strcmp(argv[1], "-b") != 0 && strcmp(argv[1], "-a") != 0)) {
-         printf("Usage: %s -b input_files -o output_file\n", argv[0]);
-        printf("       %s -a archive_file extract_directory\n", argv[0]);
+    if (argc < 3 || (strcmp(argv[1], "-b") != 0 && strcmp(argv[1], "-a") != 0 &&
+                     strcmp(argv[1], "-x") != 0 && strcmp(argv[1], "-l") != 0 &&
+                     strcmp(argv[1], "-u") != 0 && strcmp(argv[1], "-v") != 0)) {
+         printf("Usage: %s -b [--v1] [-z | -d] [--split[=size] | --cache] [-j threads] input_files -o output_file\n",
+                argv[0]);
+        printf("       %s -u archive_file [-z | -d] [-j threads] input_files\n", argv[0]);
+        printf("       %s -a archive_file extract_directory [-j threads]\n", argv[0]);
+        printf("       %s -x archive_file member_names\n", argv[0]);
+        printf("       %s -v archive_file [-j threads]\n", argv[0]);
+        printf("       %s -l archive_file\n", argv[0]);
+        printf("Any command also takes --stats or --stats=json for timings and I/O counters.\n");
+        printf("-b, -u and -a take --io-uring to batch the I/O of small files through io_uring.\n");
+        printf("They also take --rate-limit MB/s and --iops-limit ops/s to cap their disk I/O, --idle-io to\n"
+               "only use the disks while nothing else does, and --progress to show the throughput on stderr.\n");
+        printf("An output_file or archive_file of - streams the archive through stdout or stdin (-b and -a).\n");
+        printf("--split writes volumes output_file.001, .002, ... of at most size bytes (K, M or G suffix;\n"
+               "200M by default); -a, -x, -v and -l given output_file read all of them.\n");
+        printf("--cache keeps output_file.cache and copies unchanged inputs from the previous output_file.\n");
         return EXIT_FAILURE;
 
     } else if (strcmp(argv[1], "-b") == 0) {
-        FileInfo fileInfos[MAX_FILES];
-        int numFiles = 0;
+        MemberList inputs = {0};
+        char **paths = malloc(argc * sizeof(char *));
+        int numPaths = 0;
+        bool legacyFormat = false;
+        BuildOptions options = {1, false, false, useIoUring, false, 0, false};
 
         int outputIndex = -1;
         for (int i = 2; i < argc; i++) {
             if (strcmp(argv[i], "-o") == 0) {
                 outputIndex = i;
                 break;
+            } else if (strcmp(argv[i], "--v1") == 0) {
+                legacyFormat = true;  // Original single-line text header
+            } else if (strcmp(argv[i], "-z") == 0) {
+                options.compress = true;
+            } else if (strcmp(argv[i], "-d") == 0) {
+                options.dedup = true;
+            } else if (strcmp(argv[i], "--cache") == 0) {
+                options.cache = true;
+            } else if (strcmp(argv[i], "--split") == 0) {
+                options.volumeSize = MAX_SIZE;
+            } else if (strncmp(argv[i], "--split=", 8) == 0) {
+                options.volumeSize = parseSize(argv[i] + 8);
+                if (options.volumeSize == 0) {
+                    printf("Invalid volume size: %s\n", argv[i] + 8);
+                    return EXIT_FAILURE;
+                }
+            } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                options.numThreads = atoi(argv[++i]);
+                if (options.numThreads < 1) {
+                    options.numThreads = onlineCpuCount();
+                }
             } else {
-                processFile(fileInfos, &numFiles, &totalSize, argv[i]);
+                paths[numPaths++] = argv[i];
             }
         }
         if (outputIndex != -1) {
-            if (outputIndex + 1 >= argc || !strstr(argv[outputIndex + 1], ".sau")) {
+            // "-" writes the archive to standard output
+            if (outputIndex + 1 >= argc ||
+                (!strstr(argv[outputIndex + 1], ".sau") && strcmp(argv[outputIndex + 1], "-") != 0)) {
                 printf("Archive file is inappropriate or corrupt!\n");
-                freeFileInfoContent(fileInfos, numFiles);
                 return EXIT_FAILURE;
             }
             outputFileName = argv[outputIndex + 1];
@@ -68,7 +336,85 @@ int main(int argc, char *argv[]) {
             printf("Output file name not provided, using default 'a.sau'.\n");
         }
 
-        writeToArchive(fileInfos, numFiles,outputFileName);
+        if (legacyFormat && strcmp(outputFileName, "-") == 0) {
+            printf("Version 1 archives are rewritten at the end and cannot be streamed; drop --v1.\n");
+            return EXIT_FAILURE;
+        }
+        if (legacyFormat && (options.compress || options.dedup)) {
+            printf("Compression (-z) and deduplication (-d) need the version 2 format; drop --v1.\n");
+            return EXIT_FAILURE;
+        }
+        if (options.compress && options.dedup) {
+            printf("Choose either compression (-z) or deduplication (-d).\n");
+            return EXIT_FAILURE;
+        }
+        if (options.volumeSize > 0 && (legacyFormat || strcmp(outputFileName, "-") == 0)) {
+            printf("Volumes (--split) are version 2 archive files; drop --v1 and -o -.\n");
+            return EXIT_FAILURE;
+        }
+        if (options.cache && (legacyFormat || options.dedup || options.volumeSize > 0 || strcmp(outputFileName, "-") == 0)) {
+            // Deduplicated members point into earlier members and cannot move
+            printf("--cache rebuilds one version 2 archive file; drop --v1, -d, --split and -o -.\n");
+            return EXIT_FAILURE;
+        }
+
+        // Directories are expanded once -j is known, so walks can use it
+        statsPhase("collect inputs");
+        for (int i = 0; i < numPaths; i++) {
+            if (legacyFormat) {
+                processFile(&inputs, &totalSize, paths[i], options.numThreads);
+            } else {
+                // Volumes are planned from the input sizes
+                addInputPath(&inputs, paths[i], options.numThreads, options.volumeSize > 0);
+            }
+        }
+        free(paths);
+
+        if (legacyFormat) {
+            writeLegacyArchive(&inputs, outputFileName);
+        } else if (options.volumeSize > 0) {
+            writeVolumes(&inputs, outputFileName, &options);
+        } else if (options.cache) {
+            writeCachedArchive(&inputs, outputFileName, &options);
+        } else {
+            writeToArchive(&inputs, outputFileName, &options);
+        }
+        memberListFree(&inputs);
+    } else if (strcmp(argv[1], "-u") == 0) {
+        MemberList inputs = {0};
+        char **paths = malloc(argc * sizeof(char *));
+        int numPaths = 0;
+        BuildOptions options = {1, false, false, useIoUring, false, 0, false};
+
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "-z") == 0) {
+                options.compress = true;
+            } else if (strcmp(argv[i], "-d") == 0) {
+                options.dedup = true;
+            } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                options.numThreads = atoi(argv[++i]);
+                if (options.numThreads < 1) {
+                    options.numThreads = onlineCpuCount();
+                }
+            } else {
+                paths[numPaths++] = argv[i];
+            }
+        }
+        if (numPaths == 0) {
+            printf("Usage: %s -u archive_file [-z | -d] [-j threads] input_files\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (options.compress && options.dedup) {
+            printf("Choose either compression (-z) or deduplication (-d).\n");
+            return EXIT_FAILURE;
+        }
+        statsPhase("collect inputs");
+        for (int i = 0; i < numPaths; i++) {
+            addInputPath(&inputs, paths[i], options.numThreads, false);
+        }
+        free(paths);
+        updateArchive(argv[2], &inputs, &options);
+        memberListFree(&inputs);
     } else if (strcmp(argv[1], "-a") == 0) {
         if (argc < 4) {
             printf("Usage: %s -a archive_file extract_directory [-o output_file]\n", argv[0]);
@@ -76,33 +422,79 @@ int main(int argc, char *argv[]) {
         }
 
         char *archiveFileName = argv[2];
-        char *extractDirectory = argc == 4 ? argv[3] : ".";
+        char *extractDirectory = ".";
+        int numThreads = 1;
 
-        FileInfo fileInfos[MAX_FILES];
-        int numFiles = 0;
-
-        // Read the archive file to populate fileInfos with content
-        extractArchive(archiveFileName,extractDirectory);
-        
-        // Check if output file is specified
+        // Check if output file or thread count is specified
         int outputIndex = -1;
-        for (int i = 4; i < argc; i++) {
+        for (int i = 3; i < argc; i++) {
             if (strcmp(argv[i], "-o") == 0) {
                 outputIndex = i;
                 break;
+            } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                numThreads = atoi(argv[++i]);
+                if (numThreads < 1) {
+                    numThreads = onlineCpuCount();
+                }
+            } else {
+                extractDirectory = argv[i];
             }
         }
 
+        // Read the archive file and recreate its members
+        uint64_t numVolumes = countVolumes(archiveFileName);
+        if (numVolumes > 0) {
+            extractVolumes(archiveFileName, numVolumes, extractDirectory, numThreads, useIoUring);
+        } else {
+            extractArchive(archiveFileName, extractDirectory, numThreads, useIoUring);
+        }
+
         if (outputIndex != -1) {
             if (outputIndex + 1 >= argc || !strstr(argv[outputIndex + 1], ".sau")) {
                 printf("Archive file is inappropriate or corrupt!\n");
-                freeFileInfoContent(fileInfos, numFiles);
                 return EXIT_FAILURE;
             }
             outputFileName = argv[outputIndex + 1];
-        } 
-
-       // writeToArchive(fileInfos, numFiles,outputFileName);
+        }
+    } else if (strcmp(argv[1], "-x") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s -x archive_file member_names\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        extractSelectedMembers(argv[2], argv + 3, argc - 3);
+    } else if (strcmp(argv[1], "-v") == 0) {
+        int numThreads = 1;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                numThreads = atoi(argv[++i]);
+                if (numThreads < 1) {
+                    numThreads = onlineCpuCount();
+                }
+            }
+        }
+        // The volumes of a split archive are checked one after the other,
+        // each on numThreads threads
+        uint64_t numVolumes = countVolumes(argv[2]);
+        for (uint64_t volume = 1; volume <= numVolumes; volume++) {
+            char name[PATH_MAX];
+            volumeName(name, sizeof(name), argv[2], volume);
+            printf("%s: ", name);
+            fflush(stdout);
+            verifyArchive(name, numThreads);
+        }
+        if (numVolumes == 0) {
+            verifyArchive(argv[2], numThreads);
+        }
+    } else if (strcmp(argv[1], "-l") == 0) {
+        uint64_t numVolumes = countVolumes(argv[2]);
+        for (uint64_t volume = 1; volume <= numVolumes; volume++) {
+            char name[PATH_MAX];
+            volumeName(name, sizeof(name), argv[2], volume);
+            listArchive(name);
+        }
+        if (numVolumes == 0) {
+            listArchive(argv[2]);
+        }
     }
 
     return EXIT_SUCCESS;
@@ -114,222 +506,3628 @@ void handleFileError(const char *action, const char *filename) {
     exit(EXIT_FAILURE);
 }
 
-void freeFileInfoContent(FileInfo *fileInfos, int numFiles) {
-    for (int i = 0; i < numFiles; i++) {
-        free(fileInfos[i].content);
+// Copies exactly `size` bytes from inputFd to outputFile through one static
+// buffer, so memory use does not depend on the size of the member. When
+// rejectBinary is set each block is checked for NUL bytes as it passes
+// through, so the binary check costs no extra read of the file.
+// Returns 0 on success, 1 if a binary block was found and -1 on I/O errors.
+int copyFileToStream(int inputFd, FILE *outputFile, uint64_t size, bool rejectBinary) {
+    static char buffer[COPY_BUFFER_SIZE];
+
+    while (size > 0) {
+        size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        throttleIo(chunk, 1);
+        ssize_t readSize = read(inputFd, buffer, chunk);
+        if (readSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (readSize == 0) {
+            errno = EIO;  // File shrank after it was stat'ed
+            return -1;
+        }
+        if (rejectBinary) {
+            uint64_t scanStart = statsClock();
+            bool binary = containsNul(buffer, (size_t)readSize);
+            statsAdd(STATS_SCAN_BYTES, (uint64_t)readSize);
+            statsAddTime(STATS_SCAN_NS, scanStart);
+            if (binary) {
+                return 1;
+            }
+        }
+        throttleIo((uint64_t)readSize, 1);
+        if (fwrite(buffer, sizeof(char), (size_t)readSize, outputFile) != (size_t)readSize) {
+            return -1;
+        }
+        size -= (size_t)readSize;
     }
+    return 0;
 }
 
-void writeToArchive(FileInfo *fileInfos, int numFiles, const char *outputFileName) {
-    FILE *archiveFile = fopen(outputFileName, "wb");
-    if (!archiveFile) {
-        printf("Error creating archive file!\n");
-        freeFileInfoContent(fileInfos, numFiles);
-        exit(EXIT_FAILURE);
+// Copies `size` bytes starting at `offset` in the archive to the current
+// position of outputFd. The data is moved inside the kernel with
+// copy_file_range, falling back to sendfile and finally to a bounded buffer
+// when the file systems involved do not support it. The archive file offset
+// is never changed, so several threads may copy out of the same archive fd
+// at once. Returns -1 (errno EIO for a truncated archive) on error.
+int copyArchiveRange(int archiveFd, off_t offset, int outputFd, uint64_t size) {
+    static __thread char buffer[COPY_BUFFER_SIZE];
+    bool useCopyFileRange = true;
+    bool useSendfile = true;
+
+    while (size > 0) {
+        ssize_t copied;
+        size_t request = throttleChunk(size < MAX_COPY_REQUEST ? size : MAX_COPY_REQUEST);
+        throttleIo(2 * request, 1);  // Read and written in one call
+        if (useCopyFileRange) {
+            copied = copy_file_range(archiveFd, &offset, outputFd, NULL, request, 0);
+            if (copied == -1 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                useCopyFileRange = false;
+                continue;
+            }
+        } else if (useSendfile) {
+            copied = sendfile(outputFd, archiveFd, &offset, request);
+            if (copied == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                useSendfile = false;
+                continue;
+            }
+        } else {
+            size_t chunk = request < sizeof(buffer) ? request : sizeof(buffer);
+            copied = pread(archiveFd, buffer, chunk, offset);
+            if (copied > 0) {
+                for (ssize_t written = 0; written < copied; ) {
+                    ssize_t result = write(outputFd, buffer + written, copied - written);
+                    if (result == -1) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return -1;
+                    }
+                    written += result;
+                }
+                offset += copied;
+            }
+        }
+
+        if (copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (copied == 0) {
+            errno = EIO;  // Archive ends before the member does
+            return -1;
+        }
+        size -= (size_t)copied;
     }
+    return 0;
+}
 
-    // Calculate total size
-    long totalSize = 0;
-    for (int i = 0; i < numFiles; i++) {
-        totalSize += fileInfos[i].size;
+// Writes the Organization Section header without its terminating newline and
+// returns the number of bytes written, or -1. Names are escaped as legacy.h
+// describes, so separators inside them survive.
+long writeArchiveHeader(FILE *archiveFile, const MemberList *members) {
+    uint64_t totalSize = 0;
+    for (uint64_t i = 0; i < members->count; i++) {
+        totalSize += members->members[i].size;
     }
 
-    // Write the Organization Section header
-    fprintf(archiveFile, "Size: %010ld|", totalSize);
+    // At least 10 digits as before; larger totals simply take more
+    long headerLength = fprintf(archiveFile, "Size: %010llu|", (unsigned long long)totalSize);
 
-    // Write the content of each archived file
-    for (int i = 0; i < numFiles; i++) {
-        fprintf(archiveFile, "%s,%s,%ld", fileInfos[i].filename, fileInfos[i].permissions, fileInfos[i].size);
+    for (uint64_t i = 0; i < members->count; i++) {
+        const FileInfo *member = &members->members[i];
+        long nameLength = legacyWriteName(archiveFile, memberArchiveName(members, member),
+                                          memberArchiveNameLength(member));
+        if (nameLength == -1) {
+            return -1;
+        }
+        headerLength += nameLength + fprintf(archiveFile, ",%o,%llu", (unsigned)member->mode,
+                                             (unsigned long long)member->size);
 
         // Check if it's not the last file, then print a separator
-        if (i < numFiles - 1) {
-            fprintf(archiveFile, "|");
+        if (i < members->count - 1) {
+            headerLength += fprintf(archiveFile, "|");
         }
     }
+    return headerLength;
+}
 
-    // Write a newline character to separate the headers and content
-    fprintf(archiveFile, "\n");
+// Writes the TOC, names blob and trailer of a version 2 archive at the
+// current position. With sync, everything in front of the trailer is on
+// disk before the trailer is written, so a valid trailer never points at
+// data that was lost. Returns -1 on write errors.
+int writeArchiveToc(FILE *archiveFile, const MemberList *members, bool sync) {
+    static __thread unsigned char buffer[TOC_BATCH_ENTRIES * SAU_TOC_ENTRY_SIZE];
+    SauTrailer trailer = {0};
+    uint64_t numFiles = members->count;
 
-    // Write the Organization Section contents
-    for (int i = 0; i < numFiles; i++) {
-        FILE *file = fopen(fileInfos[i].filename, "rb");
-        if (!file) {
-            printf("Error opening file %s!\n", fileInfos[i].filename);
-            fclose(archiveFile);
-            freeFileInfoContent(fileInfos, numFiles);
-            exit(EXIT_FAILURE);
-        }
+    trailer.tocOffset = ftello(archiveFile);
+    trailer.entryCount = numFiles;
 
-        // Read the content of the file
-        char *fileContent = NULL;
-        fseek(file, 0, SEEK_END);
-        long fileSize = ftell(file);
-        rewind(file);
+    unsigned char tocHeader[SAU_TOC_HEADER_SIZE];
+    memcpy(tocHeader, SAU_TOC_MAGIC, SAU_MAGIC_SIZE);
+    sauPutU32(tocHeader + 4, SAU_TOC_ENTRY_SIZE);
+    sauPutU64(tocHeader + 8, numFiles);
+    fwrite(tocHeader, 1, sizeof(tocHeader), archiveFile);
 
-        if (fileSize > 0) {
-            fileContent = (char *)malloc(fileSize + 1);
-            if (!fileContent) {
-                perror("Memory allocation error");
-                fclose(file);
-                fclose(archiveFile);
-                freeFileInfoContent(fileInfos, numFiles);
-                exit(EXIT_FAILURE);
-            }
+    // Entries go out in batches; names are laid out in the same order
+    uint64_t nameOffset = 0;
+    for (uint64_t first = 0; first < numFiles; first += TOC_BATCH_ENTRIES) {
+        uint64_t count = numFiles - first < TOC_BATCH_ENTRIES ? numFiles - first : TOC_BATCH_ENTRIES;
+        for (uint64_t i = 0; i < count; i++) {
+            const FileInfo *fileInfo = &members->members[first + i];
+            SauTocEntry entry = {0};
+            entry.offset = fileInfo->offset;
+            entry.size = fileInfo->size;
+            entry.storedSize = fileInfo->storedSize;
+            entry.flags = fileInfo->flags;
+            entry.checksum = fileInfo->checksum;
+            entry.nameOffset = nameOffset;
+            entry.nameLength = memberArchiveNameLength(fileInfo);
+            entry.mode = fileInfo->mode;
+            sauEncodeTocEntry(buffer + i * SAU_TOC_ENTRY_SIZE, &entry);
+            nameOffset += entry.nameLength + 1;
+        }
+        fwrite(buffer, SAU_TOC_ENTRY_SIZE, count, archiveFile);
+    }
+
+    trailer.namesOffset = ftello(archiveFile);
+    trailer.namesLength = nameOffset;
+    for (uint64_t i = 0; i < numFiles; i++) {
+        const FileInfo *fileInfo = &members->members[i];
+        fwrite(memberArchiveName(members, fileInfo), 1, memberArchiveNameLength(fileInfo) + 1, archiveFile);
+    }
 
-            fread(fileContent, sizeof(char), fileSize, file);
-            fileContent[fileSize] = '\0';  // Null-terminate the content
+    // Name index: linear probing over a power-of-two table at most half full
+    trailer.indexOffset = ftello(archiveFile);
+    trailer.indexSlots = 1;
+    while (trailer.indexSlots < 2 * numFiles) {
+        trailer.indexSlots <<= 1;
+    }
+    unsigned char *index = calloc(trailer.indexSlots, SAU_INDEX_SLOT_SIZE);
+    if (!index) {
+        return -1;
+    }
+    uint64_t mask = trailer.indexSlots - 1;
+    for (uint64_t i = 0; i < numFiles; i++) {
+        const FileInfo *fileInfo = &members->members[i];
+        uint64_t hash = sauHashName(memberArchiveName(members, fileInfo), memberArchiveNameLength(fileInfo));
+        uint64_t slot = hash & mask;
+        while (sauGetU64(index + slot * SAU_INDEX_SLOT_SIZE + 8) != 0) {
+            slot = (slot + 1) & mask;
         }
+        sauPutU64(index + slot * SAU_INDEX_SLOT_SIZE, hash);
+        sauPutU64(index + slot * SAU_INDEX_SLOT_SIZE + 8, i + 1);
+    }
+    fwrite(index, SAU_INDEX_SLOT_SIZE, trailer.indexSlots, archiveFile);
+    free(index);
+    if (sync && (fflush(archiveFile) != 0 || fdatasync(fileno(archiveFile)) == -1)) {
+        return -1;
+    }
+
+    unsigned char encodedTrailer[SAU_TRAILER_SIZE];
+    sauEncodeTrailer(encodedTrailer, &trailer);
+    fwrite(encodedTrailer, 1, sizeof(encodedTrailer), archiveFile);
+
+    return ferror(archiveFile) ? -1 : 0;
+}
+
+// State of one input while it moves through the build pipeline
+enum {
+    SLOT_WAITING,     // Not opened yet
+    SLOT_UNREADABLE,  // Could not be opened or stat'ed, see `error`
+    SLOT_READING,     // Stat'ed; buffers are being filled
+    SLOT_DONE,        // All `size` bytes have been queued
+    SLOT_REJECTED,    // Binary content found
+    SLOT_FAILED,      // Read error, see `error`
+    SLOT_CARRIED      // Unchanged since the previous build, see `carried`
+};
+
+// A reader thread owns one slot per input it works on. The slot holds a
+// small ring of buffers that the reader fills and the writer drains, so at
+// most SLOT_BUFFERS blocks per slot are in memory at any time. There are
+// BUILD_EXTRA_SLOTS more slots than readers, so readers can finish small
+// inputs ahead of the writer rather than trading a wakeup with it for each
+// one. With -z each queued block is compressed by the compressor threads
+// before the writer may take it.
+typedef struct {
+    uint64_t fileIndex;  // Input this slot currently belongs to
+    int state;
+    int error;
+    bool sparse;          // The input has holes; only its extents are queued
+    SauExtent *extents;   // Data extents of a sparse input, freed by the writer
+    uint64_t numExtents;
+    char *buffers[SLOT_BUFFERS];
+    size_t lengths[SLOT_BUFFERS];
+    unsigned char *packed[SLOT_BUFFERS];  // Block header + compressed data
+    size_t packedLengths[SLOT_BUFFERS];   // 0: store the block uncompressed
+    bool ready[SLOT_BUFFERS];             // May be written out
+    int head;
+    int count;
+} BuildSlot;
+
+typedef struct {
+    MemberList *inputs;
+    int numSlots;
+    BuildSlot *slots;
+    atomic_uint_fast64_t nextFile;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool compress;
+    bool ioUring;
+    bool scanFirst;  // Reject binary inputs before queueing any of their data
+    int *jobs;  // Queue of slot * SLOT_BUFFERS + buffer blocks to compress
+    int jobHead;
+    int jobCount;
+    bool finished;
+    CarryOver *carry;  // With --cache
+    const CacheEntry **carried;  // Cache entry of each carried input
+} BuildPipeline;
 
-        fclose(file);
+static void setSlotState(BuildPipeline *pipeline, BuildSlot *slot, int state, int error) {
+    pthread_mutex_lock(&pipeline->lock);
+    slot->state = state;
+    slot->error = error;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
 
-        // Write the entire content to the archive file without adding newlines
-        fprintf(archiveFile, "%s", fileContent);
+// Waits until the writer has handed slot fileIndex % numSlots over to
+// input fileIndex, which bounds how far the readers can run ahead of it
+static BuildSlot *claimBuildSlot(BuildPipeline *pipeline, uint64_t fileIndex) {
+    BuildSlot *slot = &pipeline->slots[fileIndex % pipeline->numSlots];
+    pthread_mutex_lock(&pipeline->lock);
+    while (slot->fileIndex != fileIndex) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return slot;
+}
 
-        free(fileContent);
+// Waits for a free buffer in the slot's ring and returns its index. The
+// buffer is not visible to the writer until queueSlotBuffer.
+static int nextSlotBuffer(BuildPipeline *pipeline, BuildSlot *slot) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (slot->count == SLOT_BUFFERS) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
     }
+    int bufferIndex = (slot->head + slot->count) % SLOT_BUFFERS;
+    pthread_mutex_unlock(&pipeline->lock);
+    return bufferIndex;
+}
 
-    fclose(archiveFile);
+// Checks a filled buffer for binary content, adds it to the member's
+// checksum and queues it for the writer, through the compressors with -z.
+// Returns false, without queueing it, if the buffer is binary.
+static bool queueSlotBuffer(BuildPipeline *pipeline, int slotIndex, int bufferIndex, size_t length,
+                            uint32_t *checksum) {
+    BuildSlot *slot = &pipeline->slots[slotIndex];
+    uint64_t scanStart = statsClock();
+    bool binary = containsNul(slot->buffers[bufferIndex], length);
+    statsAdd(STATS_SCAN_BYTES, length);
+    statsAddTime(STATS_SCAN_NS, scanStart);
+    if (binary) {
+        return false;
+    }
+    uint64_t checksumStart = statsClock();
+    *checksum = crc32c(*checksum, slot->buffers[bufferIndex], length);
+    statsAddTime(STATS_CHECKSUM_NS, checksumStart);
 
-    printf("The files have been merged.\n");
+    pthread_mutex_lock(&pipeline->lock);
+    slot->lengths[bufferIndex] = length;
+    slot->ready[bufferIndex] = !pipeline->compress;
+    slot->count++;
+    if (pipeline->compress) {
+        int job = (pipeline->jobHead + pipeline->jobCount) % (pipeline->numSlots * SLOT_BUFFERS);
+        pipeline->jobs[job] = slotIndex * SLOT_BUFFERS + bufferIndex;
+        pipeline->jobCount++;
+    }
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return true;
 }
 
-bool isBinary(FILE *file) {
-    int ch;
-    while ((ch = fgetc(file)) != EOF) {
-        if (ch == 0) {
-            return true;  // Null byte found, indicating a binary file
+// Buffer of the reader threads for reads outside the slot buffers
+static __thread char extentBuffer[COPY_BUFFER_SIZE];
+
+// Returns the offset of the first (or, with last, the last) non-zero byte in
+// [start, end) of fd, or -1 if there is none. Sets *error on read errors.
+static int64_t findNonZero(int fd, uint64_t start, uint64_t end, bool last, int *error) {
+    while (start < end) {
+        size_t chunk = end - start < sizeof(extentBuffer) ? end - start : sizeof(extentBuffer);
+        uint64_t offset = last ? end - chunk : start;
+        throttleIo(chunk, 1);
+        ssize_t readSize = pread(fd, extentBuffer, chunk, offset);
+        if (readSize < 0 && errno == EINTR) {
+            continue;
+        }
+        if (readSize != (ssize_t)chunk) {
+            *error = readSize < 0 ? errno : EIO;
+            return -1;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            size_t index = last ? chunk - 1 - i : i;
+            if (extentBuffer[index] != 0) {
+                return offset + index;
+            }
+        }
+        if (last) {
+            end -= chunk;
+        } else {
+            start += chunk;
         }
     }
-    return false;  // No null bytes found, indicating a text file
+    return -1;
 }
 
-void processFile(FileInfo *fileInfos, int *numFiles, long *totalSize, const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (file) {
-        fseek(file, 0, SEEK_END);
-        long fileSize = ftell(file);
-        rewind(file);
-
-        // Check if the file is binary
-        if (isBinary(file)) {
-            printf("%s input file format is incompatible! \n", filename);
-            fclose(file);
-            return;
+// File systems report data in whole blocks, so the zeros that pad a block
+// out to a hole show up as data. Zero bytes next to a hole read the same as
+// the hole itself, so each extent is trimmed to its outermost non-zero bytes
+// (the edges that touch a hole) and all-zero extents are dropped. What is
+// left is the content proper, which the binary check then applies to.
+static int trimDataExtents(int fd, SauExtent *extents, uint64_t *numExtents, uint64_t size) {
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < *numExtents; i++) {
+        uint64_t start = extents[i].offset;
+        uint64_t end = start + extents[i].length;
+        int error = 0;
+        if (i > 0 || start > 0) {
+            int64_t first = findNonZero(fd, start, end, false, &error);
+            if (error) {
+                errno = error;
+                return -1;
+            }
+            if (first == -1) {
+                continue;  // Nothing but zeros
+            }
+            start = first;
+        }
+        if (i + 1 < *numExtents || end < size) {
+            int64_t last = findNonZero(fd, start, end, true, &error);
+            if (error) {
+                errno = error;
+                return -1;
+            }
+            if (last == -1) {
+                continue;
+            }
+            end = last + 1;
+        }
+        extents[kept].offset = start;
+        extents[kept].length = end - start;
+        kept++;
+    }
+    *numExtents = kept;
+    return 0;
+}
+
+// Lists the data extents of an input that has fewer blocks than its size
+// suggests. Returns 1 with the extents (possibly none) if it has holes, 0 if
+// it turns out to be dense or the file system cannot tell, -1 on errors.
+static int findDataExtents(int fd, uint64_t size, SauExtent **extents, uint64_t *numExtents) {
+    SauExtent *list = NULL;
+    uint64_t count = 0;
+    uint64_t capacity = 0;
+    off_t position = 0;
+    while ((uint64_t)position < size) {
+        off_t data = lseek(fd, position, SEEK_DATA);
+        if (data == -1 && errno == ENXIO) {
+            break;  // Only a hole is left
+        }
+        off_t hole = data == -1 ? -1 : lseek(fd, data, SEEK_HOLE);
+        if (hole == -1) {
+            free(list);
+            return errno == EINVAL ? 0 : -1;  // EINVAL: no SEEK_DATA support
+        }
+        if ((uint64_t)data >= size) {
+            break;
+        }
+        if ((uint64_t)hole > size) {
+            hole = size;  // The file grew since fstat
+        }
+        if (count == SAU_MAX_EXTENTS) {
+            free(list);
+            return 0;  // Too fragmented for an extent map; stored dense
+        }
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            SauExtent *grown = realloc(list, capacity * sizeof(SauExtent));
+            if (!grown) {
+                free(list);
+                return -1;
+            }
+            list = grown;
         }
+        list[count].offset = data;
+        list[count].length = hole - data;
+        count++;
+        position = hole;
+    }
+    if (count == 1 && list[0].offset == 0 && list[0].length == size) {
+        free(list);
+        return 0;
+    }
+    if (trimDataExtents(fd, list, &count, size) == -1) {
+        free(list);
+        return -1;
+    }
+    *extents = list;
+    *numExtents = count;
+    return 1;
+}
 
-        // Obtain file permissions
-        struct stat fileStat;
-        if (stat(filename, &fileStat) == 0) {
-            mode_t permissions = fileStat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
-            snprintf(fileInfos[*numFiles].permissions, sizeof(fileInfos[*numFiles].permissions), "%o", permissions);
-        } else {
-            perror("Failed to obtain permissions for file");
-            snprintf(fileInfos[*numFiles].permissions, sizeof(fileInfos[*numFiles].permissions), "default");
+// Reads the extents of an input once for the NUL check alone.
+// Returns 1 if it is binary, 0 if not and -1 with errno set on read errors.
+static int scanBuildInput(int fd, const SauExtent *extents, uint64_t numExtents) {
+    char *buffer = extentBuffer;
+    for (uint64_t i = 0; i < numExtents; i++) {
+        for (uint64_t done = 0; done < extents[i].length; ) {
+            uint64_t left = extents[i].length - done;
+            size_t chunk = left < sizeof(extentBuffer) ? left : sizeof(extentBuffer);
+            throttleIo(chunk, 1);
+            ssize_t readSize = pread(fd, buffer, chunk, extents[i].offset + done);
+            if (readSize < 0 && errno == EINTR) {
+                continue;
+            }
+            if (readSize <= 0) {
+                if (readSize == 0) {
+                    errno = EIO;  // File shrank after fstat
+                }
+                return -1;
+            }
+            uint64_t scanStart = statsClock();
+            bool binary = containsNul(buffer, (size_t)readSize);
+            statsAdd(STATS_SCAN_BYTES, (uint64_t)readSize);
+            statsAddTime(STATS_SCAN_NS, scanStart);
+            if (binary) {
+                return 1;
+            }
+            done += (uint64_t)readSize;
         }
+    }
+    return 0;
+}
+
+// Opens, stats and reads one input with blocking calls, block by block.
+// A file with holes is read extent by extent, so its holes are neither read
+// nor taken for binary content, and no block spans two extents.
+// With --cache, records the stat of an input and looks it up in the sidecar
+// of the previous archive. Returns true if the input is unchanged and would
+// be stored the same way, so the writer can copy its record over from the
+// previous archive instead of having it read.
+static bool carryCachedInput(BuildPipeline *pipeline, uint64_t fileIndex, const CacheKey *key) {
+    CarryOver *carry = pipeline->carry;
+    carry->keys[fileIndex] = *key;
+    if (carry->archiveFd == -1) {
+        return false;
+    }
+    const CacheEntry *entry = cacheFind(carry->entries, memberName(pipeline->inputs, &pipeline->inputs->members[fileIndex]));
+    if (!entry || !cacheKeyEqual(&entry->key, key) || (entry->flags & SAU_MEMBER_DEDUP) ||
+        (entry->flags & SAU_MEMBER_COMPRESSED) != (pipeline->compress ? SAU_MEMBER_COMPRESSED : 0)) {
+        return false;
+    }
+    pipeline->carried[fileIndex] = entry;
+    return true;
+}
 
-        strcpy(fileInfos[*numFiles].filename, filename);
-        fileInfos[*numFiles].size = fileSize;
+static void readBuildInput(BuildPipeline *pipeline, uint64_t fileIndex) {
+    FileInfo *fileInfo = &pipeline->inputs->members[fileIndex];
+    int slotIndex = fileIndex % pipeline->numSlots;
+    BuildSlot *slot = claimBuildSlot(pipeline, fileIndex);
 
-        // Allocate memory for content and read file content
-        fileInfos[*numFiles].content = (char *)malloc(fileSize + 1);
-        if (fileInfos[*numFiles].content == NULL) {
-            perror("Memory allocation error");
-            fclose(file);
+    uint64_t openStart = statsClock();
+    int fd = open(memberName(pipeline->inputs, fileInfo), O_RDONLY);
+    struct stat fileStat;
+    int statResult = fd == -1 ? -1 : fstat(fd, &fileStat);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    statsAdd(STATS_STAT_CALLS, fd != -1);
+    statsAddTime(STATS_OPEN_NS, openStart);
+    if (statResult == -1) {
+        int error = errno;
+        if (fd != -1) {
+            close(fd);
+        }
+        setSlotState(pipeline, slot, SLOT_UNREADABLE, error);
+        return;
+    }
+    if (pipeline->carry && S_ISREG(fileStat.st_mode)) {
+        CacheKey key = {fileStat.st_size, fileStat.st_mtim.tv_sec, fileStat.st_mtim.tv_nsec,
+                        fileStat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO), fileStat.st_ino,
+                        fileStat.st_ctim.tv_sec, fileStat.st_ctim.tv_nsec};
+        if (carryCachedInput(pipeline, fileIndex, &key)) {
+            close(fd);
+            setSlotState(pipeline, slot, SLOT_CARRIED, 0);
             return;
         }
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-        fread(fileInfos[*numFiles].content, sizeof(char), fileSize, file);
-        fileInfos[*numFiles].content[fileSize] = '\0';  // Null-terminate the content
-        *totalSize += fileSize;
-        (*numFiles)++;
+    fileInfo->mode = fileStat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+    fileInfo->size = fileStat.st_size;
 
-        fclose(file);
-    } else {
-        perror("Error opening file");
+    // st_blocks is a cheap hint; only files that look sparse are mapped
+    SauExtent whole = {0, fileInfo->size};
+    const SauExtent *extents = &whole;
+    uint64_t numExtents = 1;
+    if (S_ISREG(fileStat.st_mode) && (uint64_t)fileStat.st_blocks * 512 < fileInfo->size) {
+        int sparse = findDataExtents(fd, fileInfo->size, &slot->extents, &slot->numExtents);
+        if (sparse == -1) {
+            int error = errno;
+            close(fd);
+            setSlotState(pipeline, slot, SLOT_FAILED, error);
+            return;
+        }
+        if (sparse == 1) {
+            slot->sparse = true;
+            extents = slot->extents;
+            numExtents = slot->numExtents;
+        }
     }
-}
 
+    // A streamed archive cannot drop a member it has started, so inputs
+    // longer than one block are checked before their first block goes out;
+    // shorter ones are checked as that block is queued
+    if (pipeline->scanFirst && fileInfo->size > COPY_BUFFER_SIZE) {
+        int scan = scanBuildInput(fd, extents, numExtents);
+        if (scan != 0) {
+            int error = errno;
+            close(fd);
+            setSlotState(pipeline, slot, scan == 1 ? SLOT_REJECTED : SLOT_FAILED, error);
+            return;
+        }
+    }
+    setSlotState(pipeline, slot, SLOT_READING, 0);
 
-void extractArchive(const char *archiveFileName, const char *extractDirectory) {
-    FILE *archiveFile = fopen(archiveFileName, "rb");
-    if (!archiveFile) {
-        handleFileError("opening archive file", archiveFileName);
+    uint32_t checksum = 0;
+    int state = SLOT_DONE;
+    int error = 0;
+    for (uint64_t i = 0; i < numExtents && state == SLOT_DONE; i++) {
+        uint64_t done = 0;
+        while (done < extents[i].length) {
+            int bufferIndex = nextSlotBuffer(pipeline, slot);
+            uint64_t left = extents[i].length - done;
+            size_t chunk = left < COPY_BUFFER_SIZE ? left : COPY_BUFFER_SIZE;
+            throttleIo(chunk, 1);
+            ssize_t readSize = pread(fd, slot->buffers[bufferIndex], chunk, extents[i].offset + done);
+            if (readSize < 0 && errno == EINTR) {
+                continue;
+            }
+            if (readSize <= 0) {
+                state = SLOT_FAILED;
+                error = readSize == 0 ? EIO : errno;  // EIO: file shrank after fstat
+                break;
+            }
+            if (!queueSlotBuffer(pipeline, slotIndex, bufferIndex, (size_t)readSize, &checksum)) {
+                state = SLOT_REJECTED;
+                break;
+            }
+            done += (uint64_t)readSize;
+        }
     }
+    close(fd);
+    fileInfo->checksum = checksum;  // Published to the writer with the state
+    setSlotState(pipeline, slot, state, error);
+}
 
-    // Create the target directory if it doesn't exist
-    struct stat st = {0};
-    if (stat(extractDirectory, &st) == -1) {
-        if (mkdir(extractDirectory, 0755) == -1) {
-            perror("Error creating directory");
-            fclose(archiveFile);
-            exit(EXIT_FAILURE);
+// Hands an input that has already been read whole into memory (size and
+// mode filled in) to the writer
+static void feedBuildInput(BuildPipeline *pipeline, uint64_t fileIndex, const char *data) {
+    FileInfo *fileInfo = &pipeline->inputs->members[fileIndex];
+    int slotIndex = fileIndex % pipeline->numSlots;
+    BuildSlot *slot = claimBuildSlot(pipeline, fileIndex);
+    setSlotState(pipeline, slot, SLOT_READING, 0);
+
+    uint32_t checksum = 0;
+    int state = SLOT_DONE;
+    for (size_t done = 0; done < fileInfo->size; ) {
+        size_t chunk = fileInfo->size - done < COPY_BUFFER_SIZE ? fileInfo->size - done : COPY_BUFFER_SIZE;
+        int bufferIndex = nextSlotBuffer(pipeline, slot);
+        memcpy(slot->buffers[bufferIndex], data + done, chunk);
+        if (!queueSlotBuffer(pipeline, slotIndex, bufferIndex, chunk, &checksum)) {
+            state = SLOT_REJECTED;
+            break;
         }
+        done += chunk;
     }
+    fileInfo->checksum = checksum;
+    setSlotState(pipeline, slot, state, 0);
+}
 
-    if (chdir(extractDirectory) == -1) {
-        perror("Error changing directory");
-        fclose(archiveFile);
+// Submits the queued operations and waits for them. io_uring_enter only
+// fails on a broken ring, which leaves the state of the batch unknown.
+static void runUring(Uring *ring) {
+    if (uringRun(ring) == -1) {
+        perror("Error submitting to io_uring");
         exit(EXIT_FAILURE);
     }
+}
 
-    char buffer[LINE_BUFFER_SIZE];
+// Reads a run of inputs through io_uring in two round trips: every input
+// is opened and stat'ed in the first, and the small regular files are read
+// whole into arena (URING_SMALL_FILE bytes per input) and all of them
+// closed in the second. Inputs that are larger, sparse, not regular or hit
+// an error go through readBuildInput, which reports errors as usual. With
+// --cache, unchanged inputs are settled after the first round trip.
+static void readBuildBatch(BuildPipeline *pipeline, Uring *ring, char *arena, uint64_t first, uint64_t count) {
+    int fds[URING_BATCH];
+    int statResults[URING_BATCH];
+    int readResults[URING_BATCH];
+    int closeResults[URING_BATCH];
+    bool carried[URING_BATCH];
+    struct statx stats[URING_BATCH];
 
-    // Read the Organization Section header and size
-    if (fgets(buffer, sizeof(buffer), archiveFile) == NULL || strncmp(buffer, "Size: ", 6) != 0) {
-        fprintf(stderr, "Invalid archive file format (missing Size header).\n");
-        fclose(archiveFile);
-        exit(EXIT_FAILURE);
+    uint64_t openStart = statsClock();
+    for (uint64_t i = 0; i < count; i++) {
+        const char *name = memberName(pipeline->inputs, &pipeline->inputs->members[first + i]);
+        uringOpenat(ring, AT_FDCWD, name, O_RDONLY | O_CLOEXEC, 0, &fds[i]);
+        uringStatx(ring, AT_FDCWD, name, 0, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS | STATX_MTIME | STATX_INO |
+                   STATX_CTIME, &stats[i], &statResults[i]);
     }
-    // Extract total size
-    long totalSize = strtol(buffer + 6, NULL, 10);
+    runUring(ring);
+    statsAdd(STATS_OPEN_CALLS, count);
+    statsAdd(STATS_STAT_CALLS, count);
+    statsAddTime(STATS_OPEN_NS, openStart);
 
-    // Tokenize the Organization Section contents
-    char *token = strtok(buffer, "|");
+    for (uint64_t i = 0; i < count; i++) {
+        readResults[i] = -1;
+        carried[i] = false;
+        if (fds[i] < 0) {
+            continue;
+        }
+        if (pipeline->carry && statResults[i] == 0 && S_ISREG(stats[i].stx_mode)) {
+            CacheKey key = {stats[i].stx_size, stats[i].stx_mtime.tv_sec, stats[i].stx_mtime.tv_nsec,
+                            stats[i].stx_mode & (S_IRWXU | S_IRWXG | S_IRWXO), stats[i].stx_ino,
+                            stats[i].stx_ctime.tv_sec, stats[i].stx_ctime.tv_nsec};
+            carried[i] = carryCachedInput(pipeline, first + i, &key);
+            if (carried[i]) {
+                continue;
+            }
+        }
+        if (statResults[i] == 0 && S_ISREG(stats[i].stx_mode) && stats[i].stx_size <= URING_SMALL_FILE &&
+            stats[i].stx_blocks * 512 >= stats[i].stx_size) {
+            readResults[i] = 0;
+            if (stats[i].stx_size > 0) {
+                throttleIo(stats[i].stx_size, 1);
+                uringRead(ring, fds[i], arena + i * URING_SMALL_FILE, stats[i].stx_size, 0, &readResults[i]);
+            }
+        }
+    }
+    runUring(ring);
 
-    while (token != NULL) {
-        // Skip empty tokens
-        if (strlen(token) > 0) {
-            char filePath[FILEPATH_BUFFER_SIZE];
-            char permissions[10];
-            size_t fileSize;
+    for (uint64_t i = 0; i < count; i++) {
+        if (fds[i] >= 0) {
+            uringClose(ring, fds[i], &closeResults[i]);
+        }
+    }
+    runUring(ring);
 
-            // Tokenize each file entry
-            int result = sscanf(token, "%[^,],%[^,],%lu", filePath, permissions, &fileSize);
+    for (uint64_t i = 0; i < count; i++) {
+        FileInfo *fileInfo = &pipeline->inputs->members[first + i];
+        if (carried[i]) {
+            setSlotState(pipeline, claimBuildSlot(pipeline, first + i), SLOT_CARRIED, 0);
+        } else if (fds[i] >= 0 && statResults[i] == 0 && S_ISREG(stats[i].stx_mode) && stats[i].stx_size <= URING_SMALL_FILE &&
+            stats[i].stx_blocks * 512 >= stats[i].stx_size && (uint64_t)readResults[i] == stats[i].stx_size) {
+            fileInfo->mode = stats[i].stx_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+            fileInfo->size = stats[i].stx_size;
+            feedBuildInput(pipeline, first + i, arena + i * URING_SMALL_FILE);
+        } else {
+            readBuildInput(pipeline, first + i);
+        }
+    }
+}
 
-            if (result == 3) {
-                FILE *outputFile = fopen(filePath, "w");  // Change mode from "wb" to "w"
-                if (!outputFile) {
-                    handleFileError("creating file", filePath);
-                }
+// Reader thread: claims inputs in command-line order and reads them, each
+// input ending up in slot fileIndex % numSlots. With io_uring, runs of
+// URING_BATCH inputs are claimed and opened, stat'ed and read together.
+static void *buildReader(void *argument) {
+    BuildPipeline *pipeline = argument;
+    uint64_t numInputs = pipeline->inputs->count;
+    Uring *ring = pipeline->ioUring ? uringCreate(2 * URING_BATCH) : NULL;
+    char *arena = ring ? malloc(URING_BATCH * URING_SMALL_FILE) : NULL;
 
-                // Allocate memory for content
-                char *fileContent = (char *)malloc(fileSize);
-                if (!fileContent) {
-                    perror("Memory allocation error");
-                    fclose(outputFile);
-                    fclose(archiveFile);
-                    exit(EXIT_FAILURE);
-                }
+    if (ring && arena) {
+        uint64_t first;
+        while ((first = atomic_fetch_add(&pipeline->nextFile, URING_BATCH)) < numInputs) {
+            uint64_t count = numInputs - first < URING_BATCH ? numInputs - first : URING_BATCH;
+            readBuildBatch(pipeline, ring, arena, first, count);
+        }
+    } else {
+        uint64_t fileIndex;
+        while ((fileIndex = atomic_fetch_add(&pipeline->nextFile, 1)) < numInputs) {
+            readBuildInput(pipeline, fileIndex);
+        }
+    }
+    free(arena);
+    uringDestroy(ring);
+    return NULL;
+}
 
-                // Read the content of the file
-                size_t readSize = fread(fileContent, sizeof(char), fileSize, archiveFile);
+// Compressor thread: takes queued blocks in any order and compresses each
+// one independently. A block that does not shrink is stored as is.
+static void *buildCompressor(void *argument) {
+    BuildPipeline *pipeline = argument;
 
-                // Write the entire content to the file
-                fwrite(fileContent, sizeof(char), fileSize, outputFile);
+    for (;;) {
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->jobCount == 0 && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        if (pipeline->jobCount == 0) {
+            pthread_mutex_unlock(&pipeline->lock);
+            return NULL;
+        }
+        int job = pipeline->jobs[pipeline->jobHead];
+        pipeline->jobHead = (pipeline->jobHead + 1) % (pipeline->numSlots * SLOT_BUFFERS);
+        pipeline->jobCount--;
+        pthread_mutex_unlock(&pipeline->lock);
 
-                fclose(outputFile);
-                free(fileContent);
+        BuildSlot *slot = &pipeline->slots[job / SLOT_BUFFERS];
+        int bufferIndex = job % SLOT_BUFFERS;
+        size_t length = slot->lengths[bufferIndex];
+        unsigned char *packed = slot->packed[bufferIndex];
+        uint64_t compressStart = statsClock();
+        size_t packedLength = lzCompress(slot->buffers[bufferIndex], length,
+                                         packed + SAU_BLOCK_HEADER_SIZE, length - 1);
+        statsAddTime(STATS_COMPRESS_NS, compressStart);
 
-                printf("%s,",filePath);
-            }
-        }
+        sauPutU32(packed, length);
+        sauPutU32(packed + 4, packedLength ? packedLength : length);
 
-        // Get the next token
-        token = strtok(NULL, "|");
+        pthread_mutex_lock(&pipeline->lock);
+        slot->packedLengths[bufferIndex] = packedLength;
+        slot->ready[bufferIndex] = true;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
     }
+}
+
+// Output of the member writer. Records, names, extent maps and small
+// members are copied into `staged`, full blocks are referenced where they
+// lie, and everything goes out in one pwritev per BATCH_SIZE bytes, so
+// archiving many small files costs a write call per megabyte rather than
+// several per file, and large blocks are still not copied. The batch keeps
+// its own position and archiveFile is not touched until batchFinish; an
+// archive without a descriptor (-o -, already buffered by
+// openOutputStream) is written through instead.
+typedef struct {
+    FILE *archiveFile;
+    int fd;             // -1: write through archiveFile
+    uint64_t position;  // Archive offset of the next byte added
+    uint64_t start;     // Archive offset of the first byte pending
+    char *staged;       // BATCH_SIZE bytes
+    size_t stagedLength;
+    struct iovec pieces[BATCH_IOVECS];
+    int numPieces;
+    size_t pendingLength;
+    bool referenced;  // Some pieces point outside staged
+} ArchiveBatch;
+
+static void batchStart(ArchiveBatch *batch, FILE *archiveFile) {
+    memset(batch, 0, sizeof(*batch));
+    batch->archiveFile = archiveFile;
+    batch->fd = -1;
+    batch->position = ftello(archiveFile);
+    batch->start = batch->position;
+    if (fileno(archiveFile) != -1 && fflush(archiveFile) == 0) {
+        batch->staged = malloc(BATCH_SIZE);
+        if (!batch->staged) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+        batch->fd = fileno(archiveFile);
+    }
+}
+
+// Writes out everything pending. Data passed to batchWriteBlock may be
+// reused once this returns.
+static void batchFlush(ArchiveBatch *batch) {
+    struct iovec *pieces = batch->pieces;
+    int numPieces = batch->numPieces;
+    if (numPieces > 0) {
+        throttleIo(batch->pendingLength, 1);
+    }
+    while (numPieces > 0) {
+        ssize_t written = pwritev(batch->fd, pieces, numPieces, batch->start);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error writing archive");
+            exit(EXIT_FAILURE);
+        }
+        batch->start += written;
+        while (numPieces > 0 && (size_t)written >= pieces->iov_len) {
+            written -= pieces->iov_len;
+            pieces++;
+            numPieces--;
+        }
+        if (numPieces > 0) {
+            pieces->iov_base = (char *)pieces->iov_base + written;
+            pieces->iov_len -= written;
+        }
+    }
+    batch->numPieces = 0;
+    batch->pendingLength = 0;
+    batch->stagedLength = 0;
+    batch->referenced = false;
+}
+
+static void batchAddPiece(ArchiveBatch *batch, const void *data, size_t length) {
+    if (batch->numPieces == BATCH_IOVECS) {
+        batchFlush(batch);
+    }
+    batch->pieces[batch->numPieces].iov_base = (void *)data;
+    batch->pieces[batch->numPieces].iov_len = length;
+    batch->numPieces++;
+    batch->pendingLength += length;
+    batch->position += length;
+}
+
+// Copies data into the batch; data may be reused right away
+static void batchWrite(ArchiveBatch *batch, const void *data, size_t length) {
+    if (batch->fd == -1) {
+        fwrite(data, 1, length, batch->archiveFile);
+        batch->position += length;
+        return;
+    }
+    const char *bytes = data;
+    while (length > 0) {
+        if (batch->stagedLength == BATCH_SIZE || batch->pendingLength >= BATCH_SIZE) {
+            batchFlush(batch);
+        }
+        size_t piece = BATCH_SIZE - batch->stagedLength;
+        if (piece > length) {
+            piece = length;
+        }
+        char *target = batch->staged + batch->stagedLength;
+        memcpy(target, bytes, piece);
+        batch->stagedLength += piece;
+        struct iovec *last = batch->numPieces > 0 ? &batch->pieces[batch->numPieces - 1] : NULL;
+        if (last && (char *)last->iov_base + last->iov_len == target) {
+            // Extend the staged piece before it
+            last->iov_len += piece;
+            batch->pendingLength += piece;
+            batch->position += piece;
+        } else {
+            batchAddPiece(batch, target, piece);
+        }
+        bytes += piece;
+        length -= piece;
+    }
+}
+
+// Adds a block that stays in place until the next batchFlush; short blocks
+// are copied instead
+static void batchWriteBlock(ArchiveBatch *batch, const void *data, size_t length) {
+    if (batch->fd == -1 || length < BATCH_COPY_LIMIT) {
+        batchWrite(batch, data, length);
+        return;
+    }
+    batchAddPiece(batch, data, length);
+    batch->referenced = true;
+    if (batch->pendingLength >= BATCH_SIZE) {
+        batchFlush(batch);
+    }
+}
+
+// Continues writing at position, dropping what was added after it. Returns
+// -1 if the archive cannot seek.
+static int batchSeek(ArchiveBatch *batch, uint64_t position) {
+    if (batch->fd == -1) {
+        if (fseeko(batch->archiveFile, position, SEEK_SET) == -1) {
+            return -1;
+        }
+        batch->position = position;
+        return 0;
+    }
+    batchFlush(batch);
+    batch->position = position;
+    batch->start = position;
+    return 0;
+}
+
+// Writes out the rest and leaves archiveFile positioned after it
+static void batchFinish(ArchiveBatch *batch) {
+    if (batch->fd != -1) {
+        batchFlush(batch);
+        if (fseeko(batch->archiveFile, batch->position, SEEK_SET) == -1) {
+            perror("Error writing archive");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(batch->staged);
+}
+
+// Writes one drained block and returns the number of archive bytes it took
+static size_t writeBuildBlock(ArchiveBatch *batch, BuildSlot *slot, int bufferIndex, bool compress) {
+    if (!compress) {
+        batchWriteBlock(batch, slot->buffers[bufferIndex], slot->lengths[bufferIndex]);
+        return slot->lengths[bufferIndex];
+    }
+    if (slot->packedLengths[bufferIndex] > 0) {
+        size_t length = SAU_BLOCK_HEADER_SIZE + slot->packedLengths[bufferIndex];
+        batchWriteBlock(batch, slot->packed[bufferIndex], length);
+        return length;
+    }
+    batchWrite(batch, slot->packed[bufferIndex], SAU_BLOCK_HEADER_SIZE);
+    batchWriteBlock(batch, slot->buffers[bufferIndex], slot->lengths[bufferIndex]);
+    return SAU_BLOCK_HEADER_SIZE + slot->lengths[bufferIndex];
+}
+
+// Chunk-level deduplication state of the writer thread
+typedef struct {
+    ArchiveBatch *batch;
+    DedupStore *store;
+    Chunker chunker;
+    uint64_t position;  // Archive offset of the next byte written
+    uint32_t owner;     // Index of the member being written
+    const SauExtent *extents;  // Data extents of a sparse member
+    uint64_t numExtents;
+    uint64_t extentIndex;
+    uint64_t extentLeft;  // Bytes of the member or current extent still to come
+} DedupWriter;
+
+// Writes the chunk held by the chunker, either as a reference to identical
+// bytes stored earlier or as a new chunk. Returns the archive bytes used.
+static size_t writeDedupChunk(DedupWriter *writer) {
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    unsigned char record[SAU_CHUNK_HEADER_SIZE];
+    uint32_t length = writer->chunker.length;
+
+    uint64_t hashStart = statsClock();
+    sha256(writer->chunker.chunk, length, digest);
+    statsAddTime(STATS_HASH_NS, hashStart);
+    uint64_t source = dedupStoreFind(writer->store, digest, length);
+
+    sauPutU32(record, length);
+    sauPutU64(record + 4, source);
+    batchWrite(writer->batch, record, sizeof(record));
+    size_t written = sizeof(record);
+    if (source == 0) {
+        batchWrite(writer->batch, writer->chunker.chunk, length);
+        if (dedupStoreAdd(writer->store, digest, writer->position + written, length, writer->owner) == -1) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+        written += length;
+    }
+
+    writer->position += written;
+    chunkerReset(&writer->chunker);
+    return written;
+}
+
+// Runs data through the chunker, writing every chunk it completes. A chunk
+// also ends with each extent of a sparse member, so that extraction can
+// seek between them.
+static size_t writeDedupData(DedupWriter *writer, const char *data, size_t length) {
+    size_t written = 0;
+    while (length > 0) {
+        bool chunkReady;
+        size_t piece = length < writer->extentLeft ? length : writer->extentLeft;
+        size_t consumed = chunkerFeed(&writer->chunker, data, piece, &chunkReady);
+        data += consumed;
+        length -= consumed;
+        writer->extentLeft -= consumed;
+        if (chunkReady || (writer->extentLeft == 0 && writer->chunker.length > 0)) {
+            written += writeDedupChunk(writer);
+        }
+        if (writer->extentLeft == 0 && writer->extentIndex + 1 < writer->numExtents) {
+            writer->extentLeft = writer->extents[++writer->extentIndex].length;
+        }
+    }
+    return written;
+}
+
+// Records carried over from the previous archive that lie back to back there;
+// they are copied in one go when the run ends
+typedef struct {
+    uint64_t source;  // Offset in the previous archive
+    uint64_t target;  // Offset in the new one
+    uint64_t length;
+} CarryRun;
+
+// Copies length bytes at source in sourceFd to target in targetFd and leaves
+// the targetFd offset after them. On file systems that share extents
+// between files (btrfs, XFS) the block-aligned middle of the range is cloned
+// with FICLONERANGE, so it is neither read nor written; the rest, and
+// everything elsewhere, goes through copyArchiveRange. Cloning needs source
+// and target to sit at the same offset within a block, as they do while no
+// earlier member has changed size.
+static int cloneArchiveRange(int sourceFd, uint64_t source, int targetFd, uint64_t target, uint64_t length) {
+    if (lseek(targetFd, target, SEEK_SET) == -1) {
+        return -1;
+    }
+#ifdef FICLONERANGE
+    struct stat st;
+    uint64_t blockSize = fstat(targetFd, &st) == 0 && st.st_blksize > 0 ? (uint64_t)st.st_blksize : 4096;
+    uint64_t head = (blockSize - target % blockSize) % blockSize;
+    if (source % blockSize == target % blockSize && length >= head + blockSize) {
+        uint64_t middle = (length - head) / blockSize * blockSize;
+        if (copyArchiveRange(sourceFd, source, targetFd, head) == -1) {
+            return -1;
+        }
+        struct file_clone_range range = {sourceFd, source + head, middle, target + head};
+        if (ioctl(targetFd, FICLONERANGE, &range) == 0) {
+            statsAdd(STATS_CLONED_BYTES, middle);
+            if (lseek(targetFd, target + head + middle, SEEK_SET) == -1) {
+                return -1;
+            }
+            head += middle;
+        }
+        return copyArchiveRange(sourceFd, source + head, targetFd, length - head);
+    }
+#endif
+    return copyArchiveRange(sourceFd, source, targetFd, length);
+}
+
+static void flushCarryRun(ArchiveBatch *batch, const CarryOver *carry, CarryRun *run) {
+    if (run->length == 0) {
+        return;
+    }
+    batchFlush(batch);
+    if (cloneArchiveRange(carry->archiveFd, run->source, batch->fd, run->target, run->length) == -1) {
+        perror("Error copying unchanged members");
+        exit(EXIT_FAILURE);
+    }
+    batchSeek(batch, run->target + run->length);
+    run->length = 0;
+}
+
+// Writes the inputs as version 2 member records starting at the current
+// position of archiveFile, in command-line order. Up to numThreads reader
+// threads open, stat and read inputs ahead of this thread, which does the
+// writing; with options->ioUring they do so for runs of small inputs at
+// a time through io_uring. With options->compress as many compressor threads pack the
+// blocks in between. With options->dedup the writer splits members into
+// content-defined chunks and stores each distinct one once. Everything it
+// writes is gathered by an ArchiveBatch.
+// Inputs that cannot be archived are dropped from the list. A member's
+// record is only written once its first block is ready, so with
+// options->streaming (where readers check inputs whole before queueing
+// them) a rejected input never reaches the archive.
+// With carry (--cache), inputs unchanged since the previous build are not
+// read: their records are copied over from the previous archive.
+void writeArchiveMembers(FILE *archiveFile, MemberList *inputs, const BuildOptions *options, CarryOver *carry) {
+    BuildPipeline pipeline = {0};
+    pipeline.inputs = inputs;
+    pipeline.carry = carry;
+    int numReaders = options->numThreads < 1 ? 1 : options->numThreads;
+    pipeline.numSlots = numReaders + BUILD_EXTRA_SLOTS;
+    pipeline.compress = options->compress;
+    pipeline.ioUring = options->ioUring;
+    pipeline.scanFirst = options->streaming;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+    pipeline.slots = calloc(pipeline.numSlots, sizeof(BuildSlot));
+    pipeline.jobs = malloc(pipeline.numSlots * SLOT_BUFFERS * sizeof(int));
+    pipeline.carried = carry ? calloc(inputs->count ? inputs->count : 1, sizeof(CacheEntry *)) : NULL;
+    if (!pipeline.slots || !pipeline.jobs || (carry && !pipeline.carried)) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < pipeline.numSlots; i++) {
+        pipeline.slots[i].fileIndex = i;
+        for (int j = 0; j < SLOT_BUFFERS; j++) {
+            pipeline.slots[i].buffers[j] = malloc(COPY_BUFFER_SIZE);
+            if (pipeline.compress) {
+                pipeline.slots[i].packed[j] = malloc(SAU_BLOCK_HEADER_SIZE + COPY_BUFFER_SIZE);
+            }
+            if (!pipeline.slots[i].buffers[j] || (pipeline.compress && !pipeline.slots[i].packed[j])) {
+                perror("Memory allocation error");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    ArchiveBatch batch;
+    batchStart(&batch, archiveFile);
+
+    DedupWriter *dedupWriter = NULL;
+    if (options->dedup) {
+        dedupWriter = calloc(1, sizeof(DedupWriter));
+        if (!dedupWriter || !(dedupWriter->store = dedupStoreCreate())) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+        dedupWriter->batch = &batch;
+    }
+
+    int numWorkers = pipeline.compress ? 2 * numReaders : numReaders;
+    pthread_t *workers = malloc(numWorkers * sizeof(pthread_t));
+    if (!workers) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        if (pthread_create(&workers[i], NULL, i < numReaders ? buildReader : buildCompressor, &pipeline) != 0) {
+            perror("Error starting build thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t numArchived = 0;
+    CarryRun carryRun = {0, 0, 0};
+    for (uint64_t i = 0; i < inputs->count; i++) {
+        FileInfo *fileInfo = &inputs->members[i];
+        const char *name = memberName(inputs, fileInfo);
+        BuildSlot *slot = &pipeline.slots[i % pipeline.numSlots];
+        off_t recordStart = 0;
+
+        pthread_mutex_lock(&pipeline.lock);
+        while (slot->state == SLOT_WAITING || (slot->state == SLOT_READING && slot->count == 0)) {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+        }
+        int state = slot->state;
+        int queued = slot->count;
+        pthread_mutex_unlock(&pipeline.lock);
+
+        if (state == SLOT_CARRIED) {
+            // Extend the run of copied records, or start a new one where the
+            // record does not follow it in the previous archive
+            const CacheEntry *entry = pipeline.carried[i];
+            if (carryRun.length > 0 && carryRun.source + carryRun.length != entry->recordOffset) {
+                flushCarryRun(&batch, carry, &carryRun);
+            }
+            if (carryRun.length == 0) {
+                carryRun.source = entry->recordOffset;
+                carryRun.target = batch.position;
+            }
+            fileInfo->size = entry->key.size;
+            fileInfo->mode = entry->key.mode;
+            fileInfo->flags = entry->flags;
+            fileInfo->checksum = entry->checksum;
+            fileInfo->storedSize = entry->storedSize;
+            fileInfo->offset = carryRun.target + carryRun.length + (entry->dataOffset - entry->recordOffset);
+            carryRun.length += entry->dataOffset - entry->recordOffset + entry->storedSize;
+            carry->carried++;
+        } else {
+            flushCarryRun(&batch, carry, &carryRun);
+            recordStart = batch.position;
+            fileInfo->flags = SAU_MEMBER_CHECKSUM | (slot->sparse ? SAU_MEMBER_SPARSE : 0) |
+                              (pipeline.compress ? SAU_MEMBER_COMPRESSED : options->dedup ? SAU_MEMBER_DEDUP : 0);
+            fileInfo->storedSize = 0;
+        }
+        bool recordWritten = state == SLOT_READING || state == SLOT_DONE || queued > 0;
+        if (recordWritten) {
+            uint32_t nameLength = memberArchiveNameLength(fileInfo);
+            unsigned char record[SAU_RECORD_HEADER_SIZE];
+            memcpy(record, SAU_RECORD_MAGIC, SAU_MAGIC_SIZE);
+            sauPutU32(record + 4, nameLength);
+            sauPutU32(record + 8, fileInfo->mode);
+            sauPutU32(record + 12, fileInfo->flags);
+            sauPutU64(record + 16, fileInfo->size);
+            batchWrite(&batch, record, sizeof(record));
+            batchWrite(&batch, memberArchiveName(inputs, fileInfo), nameLength);
+            fileInfo->offset = recordStart + SAU_RECORD_HEADER_SIZE + nameLength;
+            if (slot->sparse) {
+                unsigned char encoded[SAU_EXTENT_SIZE];
+                sauPutU64(encoded, slot->numExtents);
+                batchWrite(&batch, encoded, SAU_EXTENT_COUNT_SIZE);
+                for (uint64_t j = 0; j < slot->numExtents; j++) {
+                    sauEncodeExtent(encoded, &slot->extents[j]);
+                    batchWrite(&batch, encoded, SAU_EXTENT_SIZE);
+                }
+                fileInfo->storedSize = SAU_EXTENT_COUNT_SIZE + slot->numExtents * SAU_EXTENT_SIZE;
+            }
+            if (dedupWriter) {
+                dedupWriter->position = fileInfo->offset + fileInfo->storedSize;
+                dedupWriter->owner = i;
+                dedupWriter->extents = slot->extents;
+                dedupWriter->numExtents = slot->sparse ? slot->numExtents : 1;
+                dedupWriter->extentIndex = 0;
+                dedupWriter->extentLeft = !slot->sparse ? fileInfo->size
+                                          : slot->numExtents > 0 ? slot->extents[0].length : 0;
+            }
+        }
+
+        // Drain the slot in order until the reader reaches a final state
+        while (recordWritten) {
+            pthread_mutex_lock(&pipeline.lock);
+            while ((slot->count == 0 && slot->state == SLOT_READING) ||
+                   (slot->count > 0 && !slot->ready[slot->head])) {
+                pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+            }
+            state = slot->state;
+            int head = slot->head;
+            int count = 0;
+            while (count < slot->count && slot->ready[(head + count) % SLOT_BUFFERS]) {
+                count++;
+            }
+            pthread_mutex_unlock(&pipeline.lock);
+
+            if (count == 0) {
+                break;
+            }
+            for (int j = 0; j < count; j++) {
+                int bufferIndex = (head + j) % SLOT_BUFFERS;
+                if (dedupWriter) {
+                    fileInfo->storedSize += writeDedupData(dedupWriter, slot->buffers[bufferIndex], slot->lengths[bufferIndex]);
+                } else {
+                    fileInfo->storedSize += writeBuildBlock(&batch, slot, bufferIndex, pipeline.compress);
+                }
+            }
+            if (batch.referenced) {
+                batchFlush(&batch);  // The buffers go back to the reader
+            }
+
+            pthread_mutex_lock(&pipeline.lock);
+            for (int j = 0; j < count; j++) {
+                slot->ready[(head + j) % SLOT_BUFFERS] = false;
+            }
+            slot->head = (head + count) % SLOT_BUFFERS;
+            slot->count -= count;
+            pthread_cond_broadcast(&pipeline.changed);
+            pthread_mutex_unlock(&pipeline.lock);
+        }
+
+        if (state == SLOT_UNREADABLE) {
+            // Report and skip it, as the stat-time check used to
+            errno = slot->error;
+            perror("Error opening file");
+        } else if (state == SLOT_FAILED) {
+            fclose(archiveFile);
+            errno = slot->error;
+            handleFileError("archiving", name);
+        } else if (state == SLOT_REJECTED) {
+            // Drop the record and the partially copied data, and any chunks
+            // later members could otherwise have pointed into it
+            printf("%s input file format is incompatible! \n", name);
+            if (recordWritten && batchSeek(&batch, recordStart) == -1) {
+                // Streamed: the file gained a NUL byte after it was checked
+                fprintf(stderr, "Error archiving file: %s changed while it was being archived\n", name);
+                exit(EXIT_FAILURE);
+            }
+            if (dedupWriter) {
+                chunkerReset(&dedupWriter->chunker);
+                dedupStoreForget(dedupWriter->store, i);
+            }
+        } else {
+            if (dedupWriter && dedupWriter->chunker.length > 0) {
+                fileInfo->storedSize += writeDedupChunk(dedupWriter);
+            }
+            if (numArchived != i) {
+                inputs->members[numArchived] = *fileInfo;
+                if (carry) {
+                    carry->keys[numArchived] = carry->keys[i];
+                }
+            }
+            numArchived++;
+        }
+
+        // Hand the slot over to the input numSlots places further on
+        pthread_mutex_lock(&pipeline.lock);
+        free(slot->extents);
+        slot->extents = NULL;
+        slot->numExtents = 0;
+        slot->sparse = false;
+        slot->state = SLOT_WAITING;
+        slot->error = 0;
+        slot->head = 0;
+        slot->count = 0;
+        slot->fileIndex = i + pipeline.numSlots;
+        pthread_cond_broadcast(&pipeline.changed);
+        pthread_mutex_unlock(&pipeline.lock);
+    }
+
+    flushCarryRun(&batch, carry, &carryRun);
+    batchFinish(&batch);
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.finished = true;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+    for (int i = 0; i < numWorkers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    for (int i = 0; i < pipeline.numSlots; i++) {
+        for (int j = 0; j < SLOT_BUFFERS; j++) {
+            free(pipeline.slots[i].buffers[j]);
+            free(pipeline.slots[i].packed[j]);
+        }
+    }
+    free(pipeline.slots);
+    free(pipeline.jobs);
+    free(pipeline.carried);
+    if (dedupWriter) {
+        dedupStoreFree(dedupWriter->store);
+        free(dedupWriter);
+    }
+    pthread_mutex_destroy(&pipeline.lock);
+    pthread_cond_destroy(&pipeline.changed);
+
+    inputs->count = numArchived;
+}
+
+// Writes the TOC for members at the current position and closes the
+// archive. With truncate, anything left past the new trailer (such as the
+// tail of a rejected last member) is cut off. With sync, the archive is on
+// disk, its trailer last, before this returns.
+void finishArchive(FILE *archiveFile, const MemberList *members, const char *archiveFileName, bool truncate,
+                   bool sync) {
+    if (writeArchiveToc(archiveFile, members, sync) == -1) {
+        handleFileError("writing archive", archiveFileName);
+    }
+
+    if (fflush(archiveFile) != 0) {
+        handleFileError("writing archive", archiveFileName);
+    }
+    if (truncate && ftruncate(fileno(archiveFile), ftello(archiveFile)) == -1) {
+        handleFileError("truncating archive", archiveFileName);
+    }
+    if (sync && fsync(fileno(archiveFile)) == -1) {
+        handleFileError("writing archive", archiveFileName);
+    }
+
+    if (fclose(archiveFile) != 0) {
+        handleFileError("writing archive", archiveFileName);
+    }
+}
+
+// Output end of a streamed archive. A pipe has no file position, so the
+// offsets the TOC needs are counted here and handed to ftello.
+typedef struct {
+    int fd;
+    off64_t position;
+} OutputStream;
+
+static ssize_t writeOutputStream(void *cookie, const char *data, size_t length) {
+    OutputStream *stream = cookie;
+    size_t written = 0;
+    throttleIo(length, 1);
+    while (written < length) {
+        ssize_t result = write(stream->fd, data + written, length - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1) {
+            break;
+        }
+        written += result;
+    }
+    stream->position += written;
+    return written > 0 ? (ssize_t)written : -1;
+}
+
+// Only reports the position; a stream cannot be rewound
+static int seekOutputStream(void *cookie, off64_t *offset, int whence) {
+    OutputStream *stream = cookie;
+    if ((whence == SEEK_CUR && *offset == 0) || (whence == SEEK_SET && *offset == stream->position)) {
+        *offset = stream->position;
+        return 0;
+    }
+    errno = ESPIPE;
+    return -1;
+}
+
+static int closeOutputStream(void *cookie) {
+    OutputStream *stream = cookie;
+    int result = close(stream->fd);
+    free(stream);
+    return result;
+}
+
+// Opens fd, normally a pipe, as a write-only archive stream with a large
+// buffer. The pipe is enlarged too where the kernel allows it, so the
+// reader at the other end wakes up less often.
+static FILE *openOutputStream(int fd) {
+    static char buffer[STREAM_BUFFER_SIZE];
+    OutputStream *stream = calloc(1, sizeof(OutputStream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->fd = fd;
+    cookie_io_functions_t functions = {NULL, writeOutputStream, seekOutputStream, closeOutputStream};
+    FILE *file = fopencookie(stream, "w", functions);
+    if (!file) {
+        free(stream);
+        return NULL;
+    }
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+    fcntl(fd, F_SETPIPE_SZ, STREAM_BUFFER_SIZE);  // Fails harmlessly on files and over the limit
+    return file;
+}
+
+// Opens an archive file for writing through a stdio buffer larger than the
+// default file system block. Members go through an ArchiveBatch of their
+// own; what remains on the stdio side is the TOC with one name per member
+// and the version 1 writer, whose header and small members are otherwise a
+// write call every few KB. The buffer belongs to the calling thread, which
+// must close the file before opening another.
+static FILE *openArchiveOutput(const char *path, const char *mode) {
+    static __thread char buffer[ARCHIVE_BUFFER_SIZE];
+    FILE *file = fopen(path, mode);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (file) {
+        setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+    }
+    return file;
+}
+
+static void writeFileHeader(FILE *archiveFile) {
+    unsigned char fileHeader[SAU_FILE_HEADER_SIZE] = {0};
+    memcpy(fileHeader, SAU_FILE_MAGIC, SAU_MAGIC_SIZE);
+    sauPutU32(fileHeader + 4, SAU_VERSION);
+    fwrite(fileHeader, 1, sizeof(fileHeader), archiveFile);
+}
+
+// Writes a version 2 archive in one forward pass: each member is preceded by
+// a small record header, and the TOC follows the data once every input has
+// been read (and checked for binary content). An outputFileName of "-"
+// streams the archive to standard output; messages then go to stderr.
+void writeToArchive(MemberList *inputs, const char *outputFileName, const BuildOptions *options) {
+    FILE *archiveFile;
+    BuildOptions streamOptions = *options;
+    if (strcmp(outputFileName, "-") == 0) {
+        if (isatty(STDOUT_FILENO)) {
+            printf("Refusing to write an archive to a terminal.\n");
+            exit(EXIT_FAILURE);
+        }
+        // Keep the archive on its own descriptor and point stdout at stderr,
+        // so no message can end up inside the archive
+        int archiveFd = dup(STDOUT_FILENO);
+        if (archiveFd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+            perror("Error redirecting standard output");
+            exit(EXIT_FAILURE);
+        }
+        archiveFile = openOutputStream(archiveFd);
+        streamOptions.streaming = true;
+        options = &streamOptions;
+    } else {
+        archiveFile = openArchiveOutput(outputFileName, "wb");
+    }
+    if (!archiveFile) {
+        printf("Error creating archive file!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    writeFileHeader(archiveFile);
+    statsPhase("write members");
+    writeArchiveMembers(archiveFile, inputs, options, NULL);
+    statsPhase("write toc");
+    finishArchive(archiveFile, inputs, outputFileName, !options->streaming, false);
+
+    printf("The files have been merged.\n");
+}
+
+// Bytes of a volume that belong to no member: file header, TOC header,
+// trailer and the smallest name index
+#define VOLUME_OVERHEAD (SAU_FILE_HEADER_SIZE + SAU_TOC_HEADER_SIZE + SAU_TRAILER_SIZE + SAU_INDEX_SLOT_SIZE)
+
+// Most bytes an input can take in a volume: record, name, data with its
+// block or chunk headers, TOC entry, name again and up to four index slots
+// (the index is at most a quarter full). A sparse input stores less data
+// than its size, and every extent after the first saves a hole of at least
+// 512 bytes, more than its map entry and extra block or chunk header cost.
+static uint64_t memberBound(const FileInfo *fileInfo, const BuildOptions *options) {
+    uint64_t nameLength = memberArchiveNameLength(fileInfo);
+    uint64_t bound = SAU_RECORD_HEADER_SIZE + nameLength + SAU_EXTENT_COUNT_SIZE + SAU_EXTENT_SIZE +
+                     fileInfo->size + SAU_TOC_ENTRY_SIZE + nameLength + 1 + 4 * SAU_INDEX_SLOT_SIZE;
+    if (options->compress) {
+        bound += SAU_BLOCK_HEADER_SIZE * (fileInfo->size / COPY_BUFFER_SIZE + 1);
+    } else if (options->dedup) {
+        bound += SAU_CHUNK_HEADER_SIZE * (fileInfo->size / DEDUP_MIN_CHUNK + 1);
+    }
+    return bound;
+}
+
+// Name of a volume of a split archive: "out.sau" has "out.sau.001",
+// "out.sau.002" and so on
+void volumeName(char *buffer, size_t size, const char *archiveFileName, uint64_t volume) {
+    if ((size_t)snprintf(buffer, size, "%s.%03llu", archiveFileName, (unsigned long long)volume) >= size) {
+        fprintf(stderr, "Error creating volume: %s: name too long\n", archiveFileName);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Number of volumes archiveFileName was split into: 0 if it is an archive
+// itself or has no first volume, otherwise the volumes up to the first
+// missing number
+uint64_t countVolumes(const char *archiveFileName) {
+    struct stat st;
+    char name[PATH_MAX];
+    if (strcmp(archiveFileName, "-") == 0 || stat(archiveFileName, &st) == 0) {
+        return 0;
+    }
+    uint64_t numVolumes = 0;
+    for (;;) {
+        volumeName(name, sizeof(name), archiveFileName, numVolumes + 1);
+        statsAdd(STATS_STAT_CALLS, 1);
+        if (stat(name, &st) == -1) {
+            return numVolumes;
+        }
+        numVolumes++;
+    }
+}
+
+typedef struct {
+    const char *outputFileName;
+    MemberList *volumes;  // Views of the inputs, one per volume
+    BuildOptions options;  // numThreads is per volume
+} VolumeJob;
+
+static void writeVolumeTask(uint64_t volumeIndex, void *context) {
+    VolumeJob *job = context;
+    char name[PATH_MAX];
+    volumeName(name, sizeof(name), job->outputFileName, volumeIndex + 1);
+    FILE *archiveFile = openArchiveOutput(name, "wb");
+    if (!archiveFile) {
+        handleFileError("creating volume", name);
+    }
+    writeFileHeader(archiveFile);
+    writeArchiveMembers(archiveFile, &job->volumes[volumeIndex], &job->options, NULL);
+    finishArchive(archiveFile, &job->volumes[volumeIndex], name, true, false);
+}
+
+// Splits the inputs, in order, into volumes outputFileName.001, .002, ...
+// of at most options->volumeSize bytes. Each volume is a complete archive
+// with its own TOC and index, planned from the input sizes before anything
+// is read, so the volumes are written in parallel: -j threads are shared
+// out among up to that many volumes at once. Volumes are filled against
+// the worst case of each input, so compressed and deduplicated volumes end
+// up smaller than the limit. An input that cannot fit in an empty volume
+// gets one of its own, which is then larger than the limit.
+void writeVolumes(MemberList *inputs, const char *outputFileName, const BuildOptions *options) {
+    uint64_t capacity = 16;
+    uint64_t numVolumes = 0;
+    MemberList *volumes = malloc(capacity * sizeof(MemberList));
+    if (!volumes) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+
+    // The views share the members and names of inputs; writeArchiveMembers
+    // compacts each view in place
+    uint64_t volumeBytes = 0;
+    for (uint64_t i = 0; i < inputs->count; i++) {
+        uint64_t bound = memberBound(&inputs->members[i], options);
+        if (numVolumes == 0 || (volumes[numVolumes - 1].count > 0 && volumeBytes + bound > options->volumeSize)) {
+            if (numVolumes == capacity) {
+                capacity *= 2;
+                MemberList *grown = realloc(volumes, capacity * sizeof(MemberList));
+                if (!grown) {
+                    perror("Memory allocation error");
+                    exit(EXIT_FAILURE);
+                }
+                volumes = grown;
+            }
+            MemberList *volume = &volumes[numVolumes++];
+            memset(volume, 0, sizeof(*volume));
+            volume->members = &inputs->members[i];
+            volume->names = inputs->names;
+            volumeBytes = VOLUME_OVERHEAD;
+        }
+        if (VOLUME_OVERHEAD + bound > options->volumeSize) {
+            printf("%s is larger than the volume size and gets a volume of its own.\n",
+                   memberName(inputs, &inputs->members[i]));
+        }
+        volumes[numVolumes - 1].count++;
+        volumeBytes += bound;
+    }
+    if (numVolumes == 0) {
+        // No inputs still make one (empty) volume, as they make an empty archive
+        memset(&volumes[numVolumes++], 0, sizeof(MemberList));
+    }
+
+    int numThreads = options->numThreads < 1 ? 1 : options->numThreads;
+    int parallelVolumes = (uint64_t)numThreads < numVolumes ? numThreads : (int)numVolumes;
+    VolumeJob job = {outputFileName, volumes, *options};
+    job.options.numThreads = numThreads / parallelVolumes;
+
+    statsPhase("write volumes");
+    runParallel(parallelVolumes, numVolumes, writeVolumeTask, &job);
+
+    // Drop volumes of an earlier, longer split, which would otherwise be
+    // read as part of this one
+    char name[PATH_MAX];
+    for (uint64_t volume = numVolumes + 1;; volume++) {
+        volumeName(name, sizeof(name), outputFileName, volume);
+        if (unlink(name) == -1) {
+            break;
+        }
+    }
+
+    // Close the gaps the rejected inputs left, so inputs lists what was archived
+    uint64_t numArchived = 0;
+    for (uint64_t i = 0; i < numVolumes; i++) {
+        if (volumes[i].count > 0) {
+            memmove(&inputs->members[numArchived], volumes[i].members, volumes[i].count * sizeof(FileInfo));
+            numArchived += volumes[i].count;
+        }
+    }
+    inputs->count = numArchived;
+    free(volumes);
+
+    printf("The files have been merged into %llu volumes.\n", (unsigned long long)numVolumes);
+}
+
+// Builds outputFileName like writeToArchive, except that inputs unchanged
+// since the previous build (same size, mtime, inode and permissions as the
+// sidecar outputFileName.cache recorded) are not read: their records are
+// copied over from the previous archive, cloned where the file system
+// allows it. The new archive is written aside and renamed over the old one,
+// and a sidecar for it replaces the old sidecar.
+void writeCachedArchive(MemberList *inputs, const char *outputFileName, const BuildOptions *options) {
+    char cacheName[PATH_MAX];
+    char temporaryName[PATH_MAX];
+    if ((size_t)snprintf(cacheName, sizeof(cacheName), "%s.cache", outputFileName) >= sizeof(cacheName) ||
+        (size_t)snprintf(temporaryName, sizeof(temporaryName), "%s.tmp", outputFileName) >= sizeof(temporaryName)) {
+        printf("Archive file name is too long!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    CarryOver carry = {NULL, -1, NULL, 0};
+    struct stat st = {0};
+    carry.archiveFd = open(outputFileName, O_RDONLY | O_CLOEXEC);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (carry.archiveFd != -1 && fstat(carry.archiveFd, &st) == -1) {
+        close(carry.archiveFd);
+        carry.archiveFd = -1;
+    }
+    // Without a previous archive nothing can be carried over, but the
+    // sidecar is still written for the next build
+    carry.entries = cacheLoad(cacheName, st.st_size, st.st_ino, st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    carry.keys = calloc(inputs->count ? inputs->count : 1, sizeof(CacheKey));
+    if (!carry.entries || !carry.keys) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *archiveFile = openArchiveOutput(temporaryName, "wb");
+    if (!archiveFile) {
+        printf("Error creating archive file!\n");
+        exit(EXIT_FAILURE);
+    }
+    writeFileHeader(archiveFile);
+    statsPhase("write members");
+    writeArchiveMembers(archiveFile, inputs, options, &carry);
+    statsPhase("write toc");
+    finishArchive(archiveFile, inputs, temporaryName, true, false);
+    if (rename(temporaryName, outputFileName) == -1) {
+        handleFileError("replacing archive", outputFileName);
+    }
+    if (carry.archiveFd != -1) {
+        close(carry.archiveFd);
+    }
+
+    // A sidecar that cannot be written only costs the next build its cache
+    if (stat(outputFileName, &st) == -1 ||
+        cacheSave(cacheName, st.st_size, st.st_ino, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, inputs, carry.keys) == -1) {
+        fprintf(stderr, "Error writing cache file: %s\n", cacheName);
+        perror(NULL);
+    }
+    cacheFree(carry.entries);
+    free(carry.keys);
+
+    printf("The files have been merged (%llu unchanged).\n", (unsigned long long)carry.carried);
+}
+
+// Archive being appended to by -u, and the length it is cut back to if the
+// update does not finish, which drops everything appended so far
+static FILE *updatedArchive;
+static off_t updatedArchiveLength;
+
+static void restoreUpdatedArchive(void) {
+    if (updatedArchive) {
+        __fpurge(updatedArchive);  // exit() must not flush it after the cut
+        if (ftruncate(fileno(updatedArchive), updatedArchiveLength) == -1) {
+            perror("Error restoring archive");
+        }
+    }
+}
+
+static void interruptUpdate(int signalNumber) {
+    // Should the cut fail, the old trailer is still intact for readers
+    if (updatedArchive) {
+        ftruncate(fileno(updatedArchive), updatedArchiveLength);
+    }
+    signal(signalNumber, SIG_DFL);
+    raise(signalNumber);
+}
+
+// Appends inputs to an existing version 2 archive. The new member records
+// go after the old trailer, and a new TOC covering old and new members
+// follows them; nothing already in the file is overwritten, and existing
+// member data is neither read nor moved. An input whose name is already in
+// the archive supersedes the old member, which keeps its place in the TOC
+// while its bytes become unreferenced. The old trailer stays valid until the
+// new one is on disk: a failed or interrupted update is cut back off, and
+// one that could not be (a crash) is skipped by readers.
+void updateArchive(const char *archiveFileName, MemberList *inputs, const BuildOptions *options) {
+    if (countVolumes(archiveFileName) > 0) {
+        printf("Split archives cannot be updated in place; rebuild %s with --split.\n", archiveFileName);
+        exit(EXIT_FAILURE);
+    }
+    FILE *archiveFile = openArchiveOutput(archiveFileName, "r+b");
+    if (!archiveFile) {
+        handleFileError("opening archive file", archiveFileName);
+    }
+
+    ArchiveToc toc;
+    SauTrailer trailer;
+    bool isLegacy;
+    statsPhase("read toc");
+    if (loadArchiveToc(archiveFile, &toc, &isLegacy) == -1 ||
+        (!isLegacy && readArchiveTrailer(fileno(archiveFile), &trailer) == -1)) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (isLegacy) {
+        printf("Version 1 archives cannot be updated in place; rebuild them without --v1.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat archiveStat;
+    if (fstat(fileno(archiveFile), &archiveStat) == -1) {
+        handleFileError("reading archive", archiveFileName);
+    }
+
+    // Anything past the trailer was left by an update cut short and is
+    // written over
+    off_t archiveEnd = trailer.indexOffset + trailer.indexSlots * SAU_INDEX_SLOT_SIZE + SAU_TRAILER_SIZE;
+    if (fseeko(archiveFile, archiveEnd, SEEK_SET) == -1) {
+        handleFileError("seeking in archive", archiveFileName);
+    }
+    updatedArchive = archiveFile;
+    updatedArchiveLength = archiveEnd;
+    atexit(restoreUpdatedArchive);
+    signal(SIGINT, interruptUpdate);
+    signal(SIGTERM, interruptUpdate);
+    signal(SIGHUP, interruptUpdate);
+    statsPhase("write members");
+    writeArchiveMembers(archiveFile, inputs, options, NULL);
+
+    // With every input rejected there is nothing to add: cut off whatever a
+    // rejected member left and keep the old TOC rather than append a copy
+    if (inputs->count == 0) {
+        __fpurge(archiveFile);
+        if (ftruncate(fileno(archiveFile), archiveStat.st_size) == -1) {
+            handleFileError("truncating archive", archiveFileName);
+        }
+        updatedArchive = NULL;
+        if (fclose(archiveFile) != 0) {
+            handleFileError("writing archive", archiveFileName);
+        }
+        freeArchiveToc(&toc);
+        printf("0 files have been added to %s.\n", archiveFileName);
+        return;
+    }
+
+    // Old members first, in their original order, then the new ones. A
+    // name seen before supersedes the earlier member in its place, matched
+    // through a table with the same probing as the archive's own index.
+    uint64_t numSlots = 16;
+    while (numSlots < 2 * (toc.count + inputs->count)) {
+        numSlots *= 2;
+    }
+    uint64_t *slots = calloc(numSlots, sizeof(uint64_t));
+    if (!slots) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    MemberList members = {0};
+    for (uint64_t i = 0; i < toc.count + inputs->count; i++) {
+        FileInfo source;
+        const char *name;
+        uint32_t nameLength;
+        if (i < toc.count) {
+            const SauTocEntry *entry = &toc.entries[i];
+            memset(&source, 0, sizeof(source));
+            source.size = entry->size;
+            source.offset = entry->offset;
+            source.storedSize = entry->storedSize;
+            source.mode = entry->mode;
+            source.flags = entry->flags;
+            source.checksum = entry->checksum;
+            name = toc.names + entry->nameOffset;
+            nameLength = entry->nameLength;
+        } else {
+            source = inputs->members[i - toc.count];
+            name = memberArchiveName(inputs, &source);
+            nameLength = memberArchiveNameLength(&source);
+        }
+
+        uint64_t slot = sauHashName(name, nameLength) & (numSlots - 1);
+        while (slots[slot] != 0 &&
+               strcmp(memberArchiveName(&members, &members.members[slots[slot] - 1]), name) != 0) {
+            slot = (slot + 1) & (numSlots - 1);
+        }
+        if (slots[slot] == 0) {
+            if (!memberListAdd(&members, name, nameLength)) {
+                perror("Memory allocation error");
+                exit(EXIT_FAILURE);
+            }
+            slots[slot] = members.count;
+        }
+        FileInfo *member = &members.members[slots[slot] - 1];
+        source.nameOffset = member->nameOffset;
+        source.nameLength = member->nameLength;
+        source.namePrefix = member->namePrefix;
+        *member = source;
+    }
+    free(slots);
+
+    statsPhase("write toc");
+    finishArchive(archiveFile, &members, archiveFileName, true, true);
+    updatedArchive = NULL;
+    memberListFree(&members);
+    freeArchiveToc(&toc);
+
+    printf("%llu files have been added to %s.\n", (unsigned long long)inputs->count, archiveFileName);
+}
+
+// Writes a version 1 (text header) archive. The header lists every member
+// before its data, so room for it is reserved up front.
+void writeLegacyArchive(MemberList *inputs, const char *outputFileName) {
+    FILE *archiveFile = openArchiveOutput(outputFileName, "wb");
+    if (!archiveFile) {
+        printf("Error creating archive file!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Reserve room for a header listing every candidate. Inputs that turn out
+    // to be binary are only discovered while they are copied, so the final
+    // header may be shorter; it is then padded with spaces, which the header
+    // parser skips.
+    long reservedLength = writeArchiveHeader(archiveFile, inputs);
+    if (reservedLength == -1) {
+        fclose(archiveFile);
+        handleFileError("writing archive", outputFileName);
+    }
+    fprintf(archiveFile, "\n");
+
+    statsPhase("write members");
+    // Stream each file into the archive; every input is read exactly once
+    uint64_t numArchived = 0;
+    for (uint64_t i = 0; i < inputs->count; i++) {
+        FileInfo *fileInfo = &inputs->members[i];
+        const char *name = memberName(inputs, fileInfo);
+        off_t memberStart = ftello(archiveFile);
+        int fd = open(name, O_RDONLY);
+        statsAdd(STATS_OPEN_CALLS, 1);
+        if (fd == -1) {
+            perror("Error opening file");
+            continue;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        int result = copyFileToStream(fd, archiveFile, fileInfo->size, true);
+        close(fd);
+        if (result == -1) {
+            fclose(archiveFile);
+            handleFileError("archiving", name);
+        }
+        if (result == 1) {
+            // Drop the partially copied member and reuse its space
+            printf("%s input file format is incompatible! \n", name);
+            fseeko(archiveFile, memberStart, SEEK_SET);
+            continue;
+        }
+
+        if (numArchived != i) {
+            inputs->members[numArchived] = *fileInfo;
+        }
+        numArchived++;
+    }
+
+    // Drop any tail left behind by a rejected last member, then write the
+    // final header over the reserved one
+    statsPhase("write toc");
+    fflush(archiveFile);
+    if (ftruncate(fileno(archiveFile), ftello(archiveFile)) == -1) {
+        handleFileError("truncating archive", outputFileName);
+    }
+    inputs->count = numArchived;
+    rewind(archiveFile);
+    long headerLength = writeArchiveHeader(archiveFile, inputs);
+    if (headerLength == -1) {
+        fclose(archiveFile);
+        handleFileError("writing archive", outputFileName);
+    }
+    fprintf(archiveFile, "%*s\n", (int)(reservedLength - headerLength), "");
+
+    if (fclose(archiveFile) != 0) {
+        handleFileError("writing archive", outputFileName);
+    }
+
+    printf("The files have been merged.\n");
+}
+
+// Records an input for the version 2 writer, whose reader threads look up
+// its size and permissions when they open it.
+void addInputFile(MemberList *inputs, const char *filename) {
+    if (!memberListAdd(inputs, filename, strlen(filename))) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Adds a command-line input of the version 2 writer: a file as it is, a
+// directory as every file below it. With statFiles the size and mode of
+// each input are filled in; the reader threads fill them in again when they
+// open it.
+void addInputPath(MemberList *inputs, const char *path, int numThreads, bool statFiles) {
+    struct stat st;
+    statsAdd(STATS_STAT_CALLS, 1);
+    int statResult = stat(path, &st);
+    if (statResult == 0 && S_ISDIR(st.st_mode)) {
+        if (walkDirectory(path, inputs, numThreads, statFiles) == -1) {
+            perror("Error opening directory");
+        }
+        return;
+    }
+    // Anything else goes to the reader threads, which report open errors
+    addInputFile(inputs, path);
+    if (statFiles && statResult == 0) {
+        FileInfo *fileInfo = &inputs->members[inputs->count - 1];
+        fileInfo->mode = st.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+        fileInfo->size = st.st_size;
+    }
+}
+
+void processFile(MemberList *inputs, uint64_t *totalSize, const char *filename, int numThreads) {
+    // Obtain file size and permissions. The content itself, and with it the
+    // binary check, is handled in a single pass by writeToArchive.
+    struct stat fileStat;
+    statsAdd(STATS_STAT_CALLS, 1);
+    int statResult = stat(filename, &fileStat);
+    if (statResult == 0 && S_ISDIR(fileStat.st_mode)) {
+        uint64_t first = inputs->count;
+        if (walkDirectory(filename, inputs, numThreads, true) == -1) {
+            perror("Error opening directory");
+        }
+        for (uint64_t i = first; i < inputs->count; i++) {
+            *totalSize += inputs->members[i].size;
+        }
+    } else if (statResult == 0) {
+        FileInfo *fileInfo = memberListAdd(inputs, filename, strlen(filename));
+        if (!fileInfo) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+        fileInfo->mode = fileStat.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+        fileInfo->size = fileStat.st_size;
+        *totalSize += fileStat.st_size;
+    } else {
+        perror("Error opening file");
+    }
+}
+
+
+// Creates the target directory if it doesn't exist and opens it; member
+// files are created relative to it
+static DirCache *openExtractDirectory(const char *extractDirectory) {
+    DirCache *tree = dirCacheOpen(extractDirectory);
+    if (!tree) {
+        perror("Error opening target directory");
+        exit(EXIT_FAILURE);
+    }
+    return tree;
+}
+
+// An archiveFileName of "-" reads the archive from standard input. A pipe
+// goes through extractStream; a file redirected to stdin is read through
+// its TOC like any other archive.
+void extractArchive(const char *archiveFileName, const char *extractDirectory, int numThreads, bool ioUring) {
+    FILE *archiveFile;
+    if (strcmp(archiveFileName, "-") == 0) {
+        if (isatty(STDIN_FILENO)) {
+            printf("Refusing to read an archive from a terminal.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (lseek(STDIN_FILENO, 0, SEEK_CUR) != 0) {
+            extractStream(STDIN_FILENO, extractDirectory);
+            return;
+        }
+        archiveFile = fdopen(STDIN_FILENO, "rb");
+    } else {
+        archiveFile = fopen(archiveFileName, "rb");
+        statsAdd(STATS_OPEN_CALLS, 1);
+    }
+    if (!archiveFile) {
+        handleFileError("opening archive file", archiveFileName);
+    }
+
+    DirCache *tree = openExtractDirectory(extractDirectory);
+
+    ArchiveToc toc;
+    statsPhase("read toc");
+    if (loadArchiveToc(archiveFile, &toc, NULL) == -1) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        fclose(archiveFile);
+        exit(EXIT_FAILURE);
+    }
+
+    statsPhase("extract members");
+    extractTocMembers(fileno(archiveFile), &toc, tree, numThreads, ioUring);
+
+    freeArchiveToc(&toc);
+    fclose(archiveFile);
+    dirCacheClose(tree);
+
+    printf("files opened in the %s directory.\n", extractDirectory);
+}
+
+typedef struct {
+    const char *archiveFileName;
+    DirCache *tree;  // Shared by all volumes
+    int numThreads;  // Per volume
+    bool ioUring;
+} VolumeExtractJob;
+
+static void extractVolumeTask(uint64_t volumeIndex, void *context) {
+    VolumeExtractJob *job = context;
+    char name[PATH_MAX];
+    volumeName(name, sizeof(name), job->archiveFileName, volumeIndex + 1);
+    int archiveFd = open(name, O_RDONLY | O_CLOEXEC);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (archiveFd == -1) {
+        handleFileError("opening volume", name);
+    }
+
+    ArchiveToc toc;
+    if (readArchiveToc(archiveFd, &toc) == -1) {
+        printf("Volume %s is inappropriate or corrupt!\n", name);
+        exit(EXIT_FAILURE);
+    }
+    extractTocMembers(archiveFd, &toc, job->tree, job->numThreads, job->ioUring);
+    freeArchiveToc(&toc);
+    close(archiveFd);
+}
+
+// Extracts every volume of a split archive. Volumes are independent
+// archives, so up to numThreads of them are extracted at once, sharing the
+// threads out among them.
+void extractVolumes(const char *archiveFileName, uint64_t numVolumes, const char *extractDirectory, int numThreads,
+                    bool ioUring) {
+    DirCache *tree = openExtractDirectory(extractDirectory);
+
+    int parallelVolumes = (uint64_t)numThreads < numVolumes ? numThreads : (int)numVolumes;
+    VolumeExtractJob job = {archiveFileName, tree, numThreads / parallelVolumes, ioUring};
+    statsPhase("extract volumes");
+    runParallel(parallelVolumes, numVolumes, extractVolumeTask, &job);
+    dirCacheClose(tree);
+
+    printf("files opened in the %s directory.\n", extractDirectory);
+}
+
+// Searches backwards from the end of the archive for the last trailer that
+// describes a TOC in front of it. The tail of an archive is only something
+// else when an update (-u) was cut short after appending to it, which leaves
+// the trailer it started from intact. Returns -1 if there is none.
+static int findLastTrailer(int archiveFd, uint64_t archiveSize, SauTrailer *trailer) {
+    static __thread unsigned char buffer[COPY_BUFFER_SIZE + SAU_TRAILER_SIZE];
+    uint64_t end = archiveSize;  // Trailers ending after end have been tried
+    for (;;) {
+        uint64_t start = end > sizeof(buffer) ? end - sizeof(buffer) : 0;
+        size_t length = end - start;
+        if (length < SAU_TRAILER_SIZE || pread(archiveFd, buffer, length, start) != (ssize_t)length) {
+            return -1;
+        }
+        for (size_t candidate = length - SAU_TRAILER_SIZE + 1; candidate-- > 0; ) {
+            unsigned char magic[SAU_MAGIC_SIZE];
+            if (buffer[candidate + 48] == SAU_TRAILER_MAGIC[0] && sauDecodeTrailer(buffer + candidate, trailer) == 0 &&
+                sauCheckTrailer(trailer, start + candidate) == 0 &&
+                pread(archiveFd, magic, sizeof(magic), trailer->tocOffset) == sizeof(magic) &&
+                memcmp(magic, SAU_TOC_MAGIC, SAU_MAGIC_SIZE) == 0) {
+                return 0;
+            }
+        }
+        if (start == 0) {
+            return -1;
+        }
+        end = start + SAU_TRAILER_SIZE - 1;  // Trailers across the window edge
+    }
+}
+
+// Reads the trailer of a version 2 archive and checks that the TOC, names
+// blob and name index tile the bytes in front of it. Returns -1 on malformed
+// input.
+int readArchiveTrailer(int archiveFd, SauTrailer *trailer) {
+    struct stat st;
+    unsigned char encoded[SAU_TRAILER_SIZE];
+
+    statsAdd(STATS_STAT_CALLS, 1);
+    if (fstat(archiveFd, &st) == -1 || st.st_size < SAU_FILE_HEADER_SIZE + SAU_TOC_HEADER_SIZE + SAU_TRAILER_SIZE) {
+        return -1;
+    }
+    uint64_t archiveSize = st.st_size;
+    if (pread(archiveFd, encoded, sizeof(encoded), archiveSize - SAU_TRAILER_SIZE) != sizeof(encoded)) {
+        return -1;
+    }
+    if (sauDecodeTrailer(encoded, trailer) == -1 || sauCheckTrailer(trailer, archiveSize - SAU_TRAILER_SIZE) == -1) {
+        return findLastTrailer(archiveFd, archiveSize, trailer);
+    }
+    return 0;
+}
+
+// Reads the TOC and names blob of a version 2 archive and checks that every
+// entry points inside the archive. Returns -1 on malformed input.
+int readArchiveToc(int archiveFd, ArchiveToc *toc) {
+    static __thread unsigned char buffer[TOC_BATCH_ENTRIES * SAU_TOC_ENTRY_SIZE];
+    SauTrailer trailer;
+
+    memset(toc, 0, sizeof(*toc));
+    if (readArchiveTrailer(archiveFd, &trailer) == -1) {
+        return -1;
+    }
+
+    unsigned char tocHeader[SAU_TOC_HEADER_SIZE];
+    if (pread(archiveFd, tocHeader, sizeof(tocHeader), trailer.tocOffset) != sizeof(tocHeader) ||
+        memcmp(tocHeader, SAU_TOC_MAGIC, SAU_MAGIC_SIZE) != 0 ||
+        sauGetU32(tocHeader + 4) != SAU_TOC_ENTRY_SIZE ||
+        sauGetU64(tocHeader + 8) != trailer.entryCount) {
+        return -1;
+    }
+
+    toc->count = trailer.entryCount;
+    toc->entries = malloc((toc->count ? toc->count : 1) * sizeof(SauTocEntry));
+    toc->names = malloc(trailer.namesLength + 1);
+    if (!toc->entries || !toc->names) {
+        freeArchiveToc(toc);
+        return -1;
+    }
+
+    if (pread(archiveFd, toc->names, trailer.namesLength, trailer.namesOffset) != (ssize_t)trailer.namesLength) {
+        freeArchiveToc(toc);
+        return -1;
+    }
+    toc->names[trailer.namesLength] = '\0';
+
+    off_t entryOffset = trailer.tocOffset + SAU_TOC_HEADER_SIZE;
+    for (uint64_t first = 0; first < toc->count; first += TOC_BATCH_ENTRIES) {
+        uint64_t count = toc->count - first < TOC_BATCH_ENTRIES ? toc->count - first : TOC_BATCH_ENTRIES;
+        ssize_t length = count * SAU_TOC_ENTRY_SIZE;
+        if (pread(archiveFd, buffer, length, entryOffset) != length) {
+            freeArchiveToc(toc);
+            return -1;
+        }
+        entryOffset += length;
+
+        for (uint64_t i = 0; i < count; i++) {
+            SauTocEntry *entry = &toc->entries[first + i];
+            sauDecodeTocEntry(buffer + i * SAU_TOC_ENTRY_SIZE, entry);
+            if (entry->nameOffset >= trailer.namesLength ||
+                entry->nameLength >= trailer.namesLength - entry->nameOffset ||
+                toc->names[entry->nameOffset + entry->nameLength] != '\0' ||
+                entry->offset > trailer.tocOffset ||
+                entry->storedSize > trailer.tocOffset - entry->offset) {
+                freeArchiveToc(toc);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+void freeArchiveToc(ArchiveToc *toc) {
+    free(toc->entries);
+    free(toc->names);
+    memset(toc, 0, sizeof(*toc));
+}
+
+// Collects the entries of a version 1 header into a TOC. Offsets are
+// counted from the end of the header until finishLegacyToc knows where it is.
+typedef struct {
+    ArchiveToc *toc;
+    uint64_t capacity;
+    uint64_t namesLength;
+    uint64_t namesCapacity;
+    uint64_t dataLength;  // Sizes of the entries so far
+} LegacyTocBuilder;
+
+static int addLegacyEntry(void *context, const char *name, size_t nameLength, uint32_t mode, uint64_t size) {
+    LegacyTocBuilder *builder = context;
+    ArchiveToc *toc = builder->toc;
+    if (toc->count == builder->capacity) {
+        builder->capacity = builder->capacity ? 2 * builder->capacity : 16;
+        SauTocEntry *entries = realloc(toc->entries, builder->capacity * sizeof(SauTocEntry));
+        if (!entries) {
+            return -1;
+        }
+        toc->entries = entries;
+    }
+    if (builder->namesLength + nameLength + 1 > builder->namesCapacity) {
+        builder->namesCapacity = builder->namesCapacity ? builder->namesCapacity : 256;
+        while (builder->namesLength + nameLength + 1 > builder->namesCapacity) {
+            builder->namesCapacity *= 2;
+        }
+        char *names = realloc(toc->names, builder->namesCapacity);
+        if (!names) {
+            return -1;
+        }
+        toc->names = names;
+    }
+    if (size > UINT64_MAX - builder->dataLength) {
+        return -1;
+    }
+
+    SauTocEntry *entry = &toc->entries[toc->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->offset = builder->dataLength;
+    entry->size = size;
+    entry->storedSize = size;
+    entry->nameOffset = builder->namesLength;
+    entry->nameLength = nameLength;
+    entry->mode = mode;
+    memcpy(toc->names + builder->namesLength, name, nameLength + 1);
+    builder->namesLength += nameLength + 1;
+    builder->dataLength += size;
+    return 0;
+}
+
+// Turns the offsets into archive offsets once the header is known to end
+// at dataOffset
+static void finishLegacyToc(LegacyTocBuilder *builder, uint64_t dataOffset) {
+    for (uint64_t i = 0; i < builder->toc->count; i++) {
+        builder->toc->entries[i].offset += dataOffset;
+    }
+}
+
+// Converts a version 1 text header into a TOC, computing each member's
+// offset from the sizes of the members before it. The header is parsed in
+// one pass over fixed-size reads, whatever its length, and the file is left
+// positioned at the first member.
+int readLegacyToc(FILE *archiveFile, ArchiveToc *toc) {
+    char buffer[LEGACY_READ_SIZE];
+    LegacyParser parser;
+    LegacyTocBuilder builder = {toc, 0, 0, 0, 0};
+
+    memset(toc, 0, sizeof(*toc));
+    legacyParserInit(&parser);
+    off_t headerStart = ftello(archiveFile);
+    while (!parser.done) {
+        size_t readSize = fread(buffer, 1, sizeof(buffer), archiveFile);
+        if (readSize == 0 || legacyParse(&parser, buffer, readSize, addLegacyEntry, &builder) == -1) {
+            if (parser.length < LEGACY_PREFIX_SIZE) {
+                fprintf(stderr, "Invalid archive file format (missing Size header).\n");
+            }
+            freeArchiveToc(toc);
+            return -1;
+        }
+    }
+    if (!toc->names && !(toc->names = malloc(1))) {
+        return -1;
+    }
+    finishLegacyToc(&builder, headerStart + parser.length);
+    if (fseeko(archiveFile, headerStart + parser.length, SEEK_SET) == -1) {
+        freeArchiveToc(toc);
+        return -1;
+    }
+    return 0;
+}
+
+// Reads the TOC of either archive version. Version 2 archives start with a
+// magic number; anything else is treated as the original text format.
+int loadArchiveToc(FILE *archiveFile, ArchiveToc *toc, bool *isLegacy) {
+    char magic[SAU_MAGIC_SIZE];
+    bool legacy = fread(magic, 1, sizeof(magic), archiveFile) != sizeof(magic) ||
+                  memcmp(magic, SAU_FILE_MAGIC, SAU_MAGIC_SIZE) != 0;
+    if (isLegacy) {
+        *isLegacy = legacy;
+    }
+    if (!legacy) {
+        return readArchiveToc(fileno(archiveFile), toc);
+    }
+    rewind(archiveFile);
+    return readLegacyToc(archiveFile, toc);
+}
+
+// Looks a member up through the name index of a version 2 archive, reading
+// only the probed slots, one TOC entry and one name per candidate.
+// Returns 1 if found, 0 if not and -1 on read errors.
+int findArchiveMember(int archiveFd, const SauTrailer *trailer, const char *name, SauTocEntry *entry) {
+    char storedName[PATH_MAX];
+    unsigned char slots[8 * SAU_INDEX_SLOT_SIZE];
+    size_t nameLength = strlen(name);
+    uint64_t hash = sauHashName(name, nameLength);
+    uint64_t mask = trailer->indexSlots - 1;
+
+    if (trailer->indexSlots == 0 || nameLength >= sizeof(storedName)) {
+        return 0;
+    }
+
+    uint64_t slot = hash & mask;
+    for (uint64_t probed = 0; probed < trailer->indexSlots; ) {
+        // Read a small run of slots at once, stopping at the end of the table
+        uint64_t run = trailer->indexSlots - slot < 8 ? trailer->indexSlots - slot : 8;
+        ssize_t length = run * SAU_INDEX_SLOT_SIZE;
+        if (pread(archiveFd, slots, length, trailer->indexOffset + slot * SAU_INDEX_SLOT_SIZE) != length) {
+            return -1;
+        }
+
+        for (uint64_t i = 0; i < run; i++, probed++) {
+            uint64_t entryIndex = sauGetU64(slots + i * SAU_INDEX_SLOT_SIZE + 8);
+            if (entryIndex == 0) {
+                return 0;
+            }
+            if (sauGetU64(slots + i * SAU_INDEX_SLOT_SIZE) != hash || entryIndex > trailer->entryCount) {
+                continue;
+            }
+
+            unsigned char encoded[SAU_TOC_ENTRY_SIZE];
+            off_t entryOffset = trailer->tocOffset + SAU_TOC_HEADER_SIZE + (entryIndex - 1) * SAU_TOC_ENTRY_SIZE;
+            if (pread(archiveFd, encoded, sizeof(encoded), entryOffset) != sizeof(encoded)) {
+                return -1;
+            }
+            sauDecodeTocEntry(encoded, entry);
+            if (entry->nameLength != nameLength ||
+                entry->nameOffset > trailer->namesLength || nameLength > trailer->namesLength - entry->nameOffset ||
+                entry->offset > trailer->tocOffset || entry->storedSize > trailer->tocOffset - entry->offset) {
+                continue;
+            }
+            if (pread(archiveFd, storedName, nameLength, trailer->namesOffset + entry->nameOffset) != (ssize_t)nameLength) {
+                return -1;
+            }
+            if (memcmp(storedName, name, nameLength) == 0) {
+                return 1;
+            }
+        }
+        slot = (slot + run) & mask;
+    }
+    return 0;
+}
+
+// Where the stored data of a member goes in the extracted file. A dense
+// member is one extent covering the whole file.
+typedef struct {
+    SauExtent *extents;  // &whole for dense members
+    uint64_t count;
+    uint64_t mapSize;   // Bytes of extent map in front of the stored data
+    uint64_t dataSize;  // Sum of the extent lengths
+    SauExtent whole;
+} MemberExtents;
+
+static void denseExtents(MemberExtents *map, uint64_t size) {
+    map->whole.offset = 0;
+    map->whole.length = size;
+    map->extents = &map->whole;
+    map->count = 1;
+    map->mapSize = 0;
+    map->dataSize = size;
+}
+
+// Decodes count encoded extents of a sparse member of the given size and
+// checks that they are non-empty, in order and disjoint, and inside the
+// file. Returns -1 (errno EIO) if they are not.
+static int decodeExtents(MemberExtents *map, const unsigned char *encoded, uint64_t count, uint64_t size) {
+    if (count > SAU_MAX_EXTENTS || count > SIZE_MAX / sizeof(SauExtent)) {
+        errno = EIO;
+        return -1;
+    }
+    map->extents = malloc((count ? count : 1) * sizeof(SauExtent));
+    if (!map->extents) {
+        return -1;
+    }
+    map->count = count;
+    map->mapSize = SAU_EXTENT_COUNT_SIZE + count * SAU_EXTENT_SIZE;
+    map->dataSize = 0;
+    uint64_t end = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        SauExtent *extent = &map->extents[i];
+        sauDecodeExtent(encoded + i * SAU_EXTENT_SIZE, extent);
+        if (extent->length == 0 || extent->offset < end || extent->offset > size ||
+            extent->length > size - extent->offset) {
+            free(map->extents);
+            errno = EIO;
+            return -1;
+        }
+        end = extent->offset + extent->length;
+        map->dataSize += extent->length;
+    }
+    return 0;
+}
+
+static void freeExtents(MemberExtents *map) {
+    if (map->extents != &map->whole) {
+        free(map->extents);
+    }
+}
+
+// Reads the extent map of a member from the archive
+static int readMemberExtents(int archiveFd, const SauTocEntry *entry, MemberExtents *map) {
+    if (!(entry->flags & SAU_MEMBER_SPARSE)) {
+        denseExtents(map, entry->size);
+        return 0;
+    }
+    unsigned char countField[SAU_EXTENT_COUNT_SIZE];
+    if (entry->storedSize < SAU_EXTENT_COUNT_SIZE ||
+        pread(archiveFd, countField, sizeof(countField), entry->offset) != sizeof(countField)) {
+        errno = EIO;
+        return -1;
+    }
+    uint64_t count = sauGetU64(countField);
+    if (count > SAU_MAX_EXTENTS || count > (entry->storedSize - SAU_EXTENT_COUNT_SIZE) / SAU_EXTENT_SIZE) {
+        errno = EIO;
+        return -1;
+    }
+    unsigned char *encoded = malloc(count * SAU_EXTENT_SIZE + 1);
+    if (!encoded) {
+        return -1;
+    }
+    int result = -1;
+    if (pread(archiveFd, encoded, count * SAU_EXTENT_SIZE, entry->offset + SAU_EXTENT_COUNT_SIZE) ==
+        (ssize_t)(count * SAU_EXTENT_SIZE)) {
+        result = decodeExtents(map, encoded, count, entry->size);
+    } else {
+        errno = EIO;
+    }
+    free(encoded);
+    return result;
+}
+
+// Moves the output position to an extent of a sparse member; the skipped
+// range stays a hole since nothing is ever written there
+static int seekExtent(int outputFd, const MemberExtents *map, uint64_t index) {
+    if (map->extents == &map->whole) {
+        return 0;
+    }
+    return lseek(outputFd, map->extents[index].offset, SEEK_SET) == -1 ? -1 : 0;
+}
+
+// One block of a compressed member
+typedef struct {
+    off_t storedOffset;
+    off_t rawOffset;
+    uint32_t storedLength;
+    uint32_t rawLength;
+} MemberBlock;
+
+typedef struct {
+    int archiveFd;
+    int outputFd;
+    const MemberBlock *blocks;
+    atomic_int error;
+} BlockJob;
+
+// Reads, decompresses and writes one block at its final position in the
+// output; blocks are independent so they can run on any thread.
+static void extractBlockTask(uint64_t blockIndex, void *context) {
+    static __thread unsigned char packed[COPY_BUFFER_SIZE];
+    static __thread char raw[COPY_BUFFER_SIZE];
+    BlockJob *job = context;
+    const MemberBlock *block = &job->blocks[blockIndex];
+
+    bool stored = block->storedLength == block->rawLength;
+    void *target = stored ? (void *)raw : (void *)packed;
+    throttleIo(block->storedLength + block->rawLength, 2);
+    if (pread(job->archiveFd, target, block->storedLength, block->storedOffset) != (ssize_t)block->storedLength) {
+        atomic_store(&job->error, errno ? errno : EIO);
+        return;
+    }
+    if (!stored) {
+        uint64_t decompressStart = statsClock();
+        int result = lzDecompress(packed, block->storedLength, raw, block->rawLength);
+        statsAddTime(STATS_DECOMPRESS_NS, decompressStart);
+        if (result == -1) {
+            atomic_store(&job->error, EIO);
+            return;
+        }
+    }
+    for (uint32_t written = 0; written < block->rawLength; ) {
+        ssize_t result = pwrite(job->outputFd, raw + written, block->rawLength - written, block->rawOffset + written);
+        if (result == -1 && errno != EINTR) {
+            atomic_store(&job->error, errno);
+            return;
+        }
+        written += result > 0 ? result : 0;
+    }
+}
+
+// Rebuilds a deduplicated member from its chunk records. Every chunk, new or
+// referenced, is copied out of the archive in the kernel.
+static int extractDedupMember(int archiveFd, const SauTocEntry *entry, const MemberExtents *map, int outputFd) {
+    off_t position = entry->offset + map->mapSize;
+    off_t end = entry->offset + entry->storedSize;
+    uint64_t extracted = 0;
+    uint64_t extentIndex = 0;
+    uint64_t extentEnd = 0;  // Stored bytes up to the end of the current extent
+
+    while (extracted < map->dataSize) {
+        if (extracted == extentEnd) {
+            if (seekExtent(outputFd, map, extentIndex) == -1) {
+                return -1;
+            }
+            extentEnd += map->extents[extentIndex++].length;
+        }
+        unsigned char record[SAU_CHUNK_HEADER_SIZE];
+        throttleIo(sizeof(record), 1);
+        if (end - position < SAU_CHUNK_HEADER_SIZE ||
+            pread(archiveFd, record, sizeof(record), position) != sizeof(record)) {
+            break;
+        }
+        position += SAU_CHUNK_HEADER_SIZE;
+        uint32_t length = sauGetU32(record);
+        uint64_t source = sauGetU64(record + 4);
+        if (length == 0 || length > DEDUP_MAX_CHUNK || length > extentEnd - extracted) {
+            break;
+        }
+        if (source == 0) {
+            if (length > end - position) {
+                break;
+            }
+            source = position;
+            position += length;
+        } else if (source < SAU_FILE_HEADER_SIZE || source >= (uint64_t)position) {
+            break;  // References only ever point backwards
+        }
+        if (copyArchiveRange(archiveFd, source, outputFd, length) == -1) {
+            return -1;
+        }
+        extracted += length;
+    }
+
+    if (extracted != map->dataSize || position != end) {
+        errno = EIO;  // Malformed or truncated member
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the stored data of a member, extent by extent, to outputFd
+static int extractMemberData(int archiveFd, const SauTocEntry *entry, const MemberExtents *map, int outputFd,
+                             int numThreads) {
+    if (entry->flags & SAU_MEMBER_DEDUP) {
+        return extractDedupMember(archiveFd, entry, map, outputFd);
+    }
+    if (!(entry->flags & SAU_MEMBER_COMPRESSED)) {
+        if (map->mapSize + map->dataSize != entry->storedSize) {
+            errno = EIO;
+            return -1;
+        }
+        off_t position = entry->offset + map->mapSize;
+        for (uint64_t i = 0; i < map->count; i++) {
+            if (seekExtent(outputFd, map, i) == -1 ||
+                copyArchiveRange(archiveFd, position, outputFd, map->extents[i].length) == -1) {
+                return -1;
+            }
+            position += map->extents[i].length;
+        }
+        return 0;
+    }
+
+    // Walk the block headers to find where every block lives; blocks are
+    // written at their final file offsets, so holes are simply skipped
+    size_t capacity = map->dataSize / COPY_BUFFER_SIZE + map->count + 1;
+    size_t numBlocks = 0;
+    MemberBlock *blocks = malloc(capacity * sizeof(MemberBlock));
+    off_t position = entry->offset + map->mapSize;
+    off_t end = entry->offset + entry->storedSize;
+    bool malformed = !blocks;
+    for (uint64_t i = 0; i < map->count && !malformed; i++) {
+        off_t rawOffset = map->extents[i].offset;
+        off_t extentEnd = rawOffset + map->extents[i].length;
+        while (rawOffset < extentEnd) {
+            unsigned char header[SAU_BLOCK_HEADER_SIZE];
+            throttleIo(sizeof(header), 1);
+            if (end - position < SAU_BLOCK_HEADER_SIZE ||
+                pread(archiveFd, header, sizeof(header), position) != sizeof(header)) {
+                malformed = true;
+                break;
+            }
+            MemberBlock block = {position + SAU_BLOCK_HEADER_SIZE, rawOffset, sauGetU32(header + 4), sauGetU32(header)};
+            if (block.rawLength == 0 || block.rawLength > COPY_BUFFER_SIZE || block.storedLength > block.rawLength ||
+                block.storedLength > end - block.storedOffset || block.rawLength > extentEnd - rawOffset) {
+                malformed = true;
+                break;
+            }
+            if (numBlocks == capacity) {
+                capacity *= 2;
+                MemberBlock *grown = realloc(blocks, capacity * sizeof(MemberBlock));
+                if (!grown) {
+                    malformed = true;
+                    break;
+                }
+                blocks = grown;
+            }
+            blocks[numBlocks++] = block;
+            position = block.storedOffset + block.storedLength;
+            rawOffset += block.rawLength;
+        }
+    }
+    if (malformed || position != end) {
+        free(blocks);
+        errno = EIO;  // Malformed or truncated member
+        return -1;
+    }
+
+    BlockJob job = {archiveFd, outputFd, blocks, 0};
+    runParallel(numThreads, numBlocks, extractBlockTask, &job);
+    free(blocks);
+    if (atomic_load(&job.error) != 0) {
+        errno = atomic_load(&job.error);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the content of one member to outputFd. Plain and deduplicated
+// members are copied in the kernel; compressed members are decoded block by
+// block on up to numThreads threads. The holes of a sparse member are left
+// unwritten, and the file is then extended to its full size, so they stay
+// holes. Returns -1 with errno set on failure.
+int extractMember(int archiveFd, const SauTocEntry *entry, int outputFd, int numThreads) {
+    MemberExtents map;
+    if (readMemberExtents(archiveFd, entry, &map) == -1) {
+        return -1;
+    }
+    int result = extractMemberData(archiveFd, entry, &map, outputFd, numThreads);
+    if (result == 0 && (entry->flags & SAU_MEMBER_SPARSE)) {
+        result = ftruncate(outputFd, entry->size);
+    }
+    freeExtents(&map);
+    return result;
+}
+
+// Member names must stay below the extraction directory: no absolute paths
+// and no ".." components
+static bool isSafeMemberName(const char *name) {
+    if (name[0] == '\0' || name[0] == '/') {
+        return false;
+    }
+    for (const char *component = name; component; component = strchr(component, '/')) {
+        if (*component == '/') {
+            component++;
+        }
+        if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Creates the output file of a member below tree with the member's stored
+// permissions. The file is preallocated to the member's size, unless it is
+// small or sparse, so large members land in few extents and a full disk is
+// reported before any data is written.
+static int createMemberFile(DirCache *tree, const char *name, uint32_t mode, uint64_t size, uint32_t flags) {
+    if (!isSafeMemberName(name)) {
+        fprintf(stderr, "Refusing to extract %s: it would be written outside the target directory\n", name);
+        errno = EINVAL;
+        return -1;
+    }
+    uint64_t openStart = statsClock();
+    int outputFd = dirCacheCreateFile(tree, name, 0600);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    statsAddTime(STATS_OPEN_NS, openStart);
+    if (outputFd == -1) {
+        return -1;
+    }
+
+    // Set on the descriptor, which stays writable whatever the mode is
+    bool failed = fchmod(outputFd, mode & (S_IRWXU | S_IRWXG | S_IRWXO)) == -1;
+    if (!failed && size >= PREALLOCATE_MIN && !(flags & SAU_MEMBER_SPARSE) &&
+        fallocate(outputFd, FALLOC_FL_KEEP_SIZE, 0, size) == -1) {
+        // Only a lack of space matters; some file systems cannot preallocate
+        failed = errno == ENOSPC || errno == EDQUOT;
+    }
+    if (failed) {
+        int savedErrno = errno;
+        close(outputFd);
+        errno = savedErrno;
+        return -1;
+    }
+    return outputFd;
+}
+
+typedef struct {
+    int archiveFd;
+    const ArchiveToc *toc;
+    DirCache *tree;
+    int blockThreads;  // Threads per compressed member
+    uint64_t rangeSize;  // Members per task with io_uring
+} ExtractJob;
+
+// Extracts one member. Every offset comes from the TOC and all archive reads
+// are positional, so members can be extracted in any order and in parallel.
+static void extractMemberTask(uint64_t memberIndex, void *context) {
+    ExtractJob *job = context;
+    const SauTocEntry *entry = &job->toc->entries[memberIndex];
+    const char *filePath = job->toc->names + entry->nameOffset;
+
+    int outputFd = createMemberFile(job->tree, filePath, entry->mode, entry->size, entry->flags);
+    if (outputFd == -1) {
+        handleFileError("creating file", filePath);
+    }
+    if (extractMember(job->archiveFd, entry, outputFd, job->blockThreads) == -1) {
+        handleFileError("extracting", filePath);
+    }
+    close(outputFd);
+
+    printf("%s,", filePath);
+}
 
-    fclose(archiveFile);
+// Extracts a run of members through io_uring. The output files are
+// created here; then the data of the small plain members is read from the
+// archive, written out and the files closed, one round trip for each step.
+// (Chaining the steps per member instead makes the kernel hand every chain
+// to a worker thread, which costs more than the round trips.) Compressed,
+// deduplicated, sparse, large and failed members go through
+// extractMemberTask.
+static void extractBatch(ExtractJob *job, Uring *ring, char *arena, uint64_t first, uint64_t count) {
+    int fds[URING_BATCH];
+    int readResults[URING_BATCH];
+    int writeResults[URING_BATCH];
+    int closeResults[URING_BATCH];
+    bool batched[URING_BATCH];
+
+    for (uint64_t i = 0; i < count; i++) {
+        const SauTocEntry *entry = &job->toc->entries[first + i];
+        const char *filePath = job->toc->names + entry->nameOffset;
+        batched[i] = !(entry->flags & (SAU_MEMBER_COMPRESSED | SAU_MEMBER_DEDUP | SAU_MEMBER_SPARSE)) &&
+                     entry->size <= URING_SMALL_FILE && isSafeMemberName(filePath) &&
+                     (fds[i] = createMemberFile(job->tree, filePath, entry->mode, entry->size, entry->flags)) != -1;
+        readResults[i] = 0;
+        writeResults[i] = 0;
+        if (batched[i] && entry->size > 0) {
+            throttleIo(2 * entry->size, 2);  // Read here, written below
+            uringRead(ring, job->archiveFd, arena + i * URING_SMALL_FILE, entry->size, entry->offset, &readResults[i]);
+        }
+    }
+    runUring(ring);
+
+    for (uint64_t i = 0; i < count; i++) {
+        const SauTocEntry *entry = &job->toc->entries[first + i];
+        if (batched[i] && entry->size > 0 && (uint64_t)readResults[i] == entry->size) {
+            uringWrite(ring, fds[i], arena + i * URING_SMALL_FILE, entry->size, 0, &writeResults[i]);
+        }
+    }
+    runUring(ring);
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (batched[i]) {
+            uringClose(ring, fds[i], &closeResults[i]);
+        }
+    }
+    runUring(ring);
+
+    // Members that did not make it through are redone, and their errors
+    // reported, by the blocking path
+    for (uint64_t i = 0; i < count; i++) {
+        const SauTocEntry *entry = &job->toc->entries[first + i];
+        if (batched[i] && (uint64_t)readResults[i] == entry->size && (uint64_t)writeResults[i] == entry->size &&
+            closeResults[i] == 0) {
+            printf("%s,", job->toc->names + entry->nameOffset);
+        } else {
+            extractMemberTask(first + i, job);
+        }
+    }
+}
+
+static void extractRangeTask(uint64_t rangeIndex, void *context) {
+    ExtractJob *job = context;
+    uint64_t first = rangeIndex * job->rangeSize;
+    uint64_t end = job->toc->count - first < job->rangeSize ? job->toc->count : first + job->rangeSize;
+    Uring *ring = uringCreate(2 * URING_BATCH);
+    char *arena = ring ? malloc(URING_BATCH * URING_SMALL_FILE) : NULL;
+
+    for (uint64_t batch = first; batch < end; batch += URING_BATCH) {
+        uint64_t count = end - batch < URING_BATCH ? end - batch : URING_BATCH;
+        if (arena) {
+            extractBatch(job, ring, arena, batch, count);
+        } else {
+            for (uint64_t i = 0; i < count; i++) {
+                extractMemberTask(batch + i, job);
+            }
+        }
+    }
+    free(arena);
+    uringDestroy(ring);
+}
+
+// Extracts every member on up to numThreads threads. With ioUring, and a
+// kernel that supports it, each thread takes ranges of members and batches
+// the I/O of the small ones.
+void extractTocMembers(int archiveFd, const ArchiveToc *toc, DirCache *tree, int numThreads, bool ioUring) {
+    // Threads left over when there are fewer members than threads go to the
+    // blocks of compressed members
+    int blockThreads = (uint64_t)numThreads > toc->count && toc->count > 0 ? numThreads / toc->count : 1;
+    ExtractJob job = {archiveFd, toc, tree, blockThreads, URING_RANGE};
+
+    Uring *probe = ioUring ? uringCreate(2 * URING_BATCH) : NULL;
+    if (probe) {
+        uringDestroy(probe);
+        runParallel(numThreads, (toc->count + URING_RANGE - 1) / URING_RANGE, extractRangeTask, &job);
+    } else {
+        runParallel(numThreads, toc->count, extractMemberTask, &job);
+    }
+}
+
+// Writes all of data to fd. Returns -1 with errno set on failure.
+static int writeFully(int fd, const void *data, size_t length) {
+    const char *bytes = data;
+    throttleIo(length, 1);
+    while (length > 0) {
+        ssize_t result = write(fd, bytes, length);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += result;
+        length -= (size_t)result;
+    }
+    return 0;
+}
+
+// Forward-only reader of an archive that arrives through a pipe
+typedef struct {
+    int fd;
+    char *buffer;  // STREAM_BUFFER_SIZE bytes
+    size_t start;  // Next unread byte of buffer
+    size_t end;
+    uint64_t position;  // Archive offset of buffer[start]
+    bool useSplice;
+} ArchiveStream;
+
+// Refills the buffer once it has been used up. Returns the number of bytes
+// available, 0 at the end of the stream and -1 on read errors.
+static ssize_t fillArchiveStream(ArchiveStream *stream) {
+    if (stream->start < stream->end) {
+        return stream->end - stream->start;
+    }
+    stream->start = 0;
+    stream->end = 0;
+    for (;;) {
+        ssize_t readSize = read(stream->fd, stream->buffer, STREAM_BUFFER_SIZE);
+        if (readSize == -1 && errno == EINTR) {
+            continue;
+        }
+        if (readSize > 0) {
+            throttleIo((uint64_t)readSize, 1);  // Pipe reads are short, so charge what came
+            stream->end = readSize;
+        }
+        return readSize;
+    }
+}
+
+// Reads exactly length bytes. Returns -1 (errno EIO if the stream ended first).
+static int readArchiveStream(ArchiveStream *stream, void *data, size_t length) {
+    char *bytes = data;
+    while (length > 0) {
+        ssize_t available = fillArchiveStream(stream);
+        if (available <= 0) {
+            if (available == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        size_t chunk = length < (size_t)available ? length : (size_t)available;
+        memcpy(bytes, stream->buffer + stream->start, chunk);
+        stream->start += chunk;
+        stream->position += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Copies the next length bytes of the stream to outputFd. What is already
+// buffered is written out; the rest moves from the pipe to the file with
+// splice, without passing through user space, where the kernel supports it.
+static int copyArchiveStream(ArchiveStream *stream, int outputFd, uint64_t length) {
+    size_t buffered = stream->end - stream->start;
+    size_t chunk = length < buffered ? length : buffered;
+    if (writeFully(outputFd, stream->buffer + stream->start, chunk) == -1) {
+        return -1;
+    }
+    stream->start += chunk;
+    stream->position += chunk;
+    length -= chunk;
+
+    while (length > 0 && stream->useSplice) {
+        size_t request = throttleChunk(length < STREAM_BUFFER_SIZE ? length : STREAM_BUFFER_SIZE);
+        throttleIo(2 * request, 1);  // Read and written in one call
+        ssize_t moved = splice(stream->fd, NULL, outputFd, NULL, request, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved == -1 && errno == EINTR) {
+            continue;
+        }
+        if (moved == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            stream->useSplice = false;  // Not a pipe, or a file system without splice
+            break;
+        }
+        if (moved <= 0) {
+            if (moved == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        stream->position += moved;
+        length -= moved;
+    }
+
+    while (length > 0) {
+        ssize_t available = fillArchiveStream(stream);
+        if (available <= 0) {
+            if (available == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        chunk = length < (size_t)available ? length : (size_t)available;
+        if (writeFully(outputFd, stream->buffer + stream->start, chunk) == -1) {
+            return -1;
+        }
+        stream->start += chunk;
+        stream->position += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Decodes the blocks of a compressed member as they arrive
+static int extractStreamBlocks(ArchiveStream *stream, uint64_t size, int outputFd) {
+    static unsigned char packed[COPY_BUFFER_SIZE];
+    static char raw[COPY_BUFFER_SIZE];
+
+    for (uint64_t extracted = 0; extracted < size; ) {
+        unsigned char header[SAU_BLOCK_HEADER_SIZE];
+        if (readArchiveStream(stream, header, sizeof(header)) == -1) {
+            return -1;
+        }
+        uint32_t rawLength = sauGetU32(header);
+        uint32_t storedLength = sauGetU32(header + 4);
+        if (rawLength == 0 || rawLength > COPY_BUFFER_SIZE || storedLength > rawLength ||
+            rawLength > size - extracted) {
+            errno = EIO;
+            return -1;
+        }
+        if (storedLength == rawLength) {
+            if (copyArchiveStream(stream, outputFd, rawLength) == -1) {
+                return -1;
+            }
+        } else {
+            if (readArchiveStream(stream, packed, storedLength) == -1) {
+                return -1;
+            }
+            uint64_t decompressStart = statsClock();
+            int result = lzDecompress(packed, storedLength, raw, rawLength);
+            statsAddTime(STATS_DECOMPRESS_NS, decompressStart);
+            if (result == -1) {
+                errno = EIO;
+                return -1;
+            }
+            if (writeFully(outputFd, raw, rawLength) == -1) {
+                return -1;
+            }
+        }
+        extracted += rawLength;
+    }
+    return 0;
+}
+
+// A new chunk of a deduplicated stream, kept for later references to it
+typedef struct {
+    uint64_t archiveOffset;
+    uint64_t spillOffset;
+    uint32_t length;
+} StreamChunk;
+
+// References of deduplicated members point back into the archive, which a
+// pipe cannot reread, so every new chunk is also kept in an unlinked spill
+// file in the extraction directory. (The extracted files themselves may be
+// overwritten by a later member of the same name.)
+typedef struct {
+    int directoryFd;  // Extraction directory
+    int spillFd;
+    uint64_t spillLength;
+    StreamChunk *chunks;  // In archive order, so sorted by archiveOffset
+    uint64_t count;
+    uint64_t capacity;
+} StreamChunks;
+
+static const StreamChunk *findStreamChunk(const StreamChunks *chunks, uint64_t archiveOffset) {
+    uint64_t low = 0;
+    uint64_t high = chunks->count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (chunks->chunks[middle].archiveOffset < archiveOffset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < chunks->count && chunks->chunks[low].archiveOffset == archiveOffset ? &chunks->chunks[low] : NULL;
+}
+
+// Rebuilds a deduplicated member from its chunk records as they arrive
+static int extractStreamChunks(ArchiveStream *stream, uint64_t size, int outputFd, StreamChunks *chunks) {
+    static char chunk[DEDUP_MAX_CHUNK];
+
+    if (chunks->spillFd == -1) {
+        chunks->spillFd = openat(chunks->directoryFd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (chunks->spillFd == -1) {
+            return -1;
+        }
+    }
+
+    for (uint64_t extracted = 0; extracted < size; ) {
+        unsigned char record[SAU_CHUNK_HEADER_SIZE];
+        if (readArchiveStream(stream, record, sizeof(record)) == -1) {
+            return -1;
+        }
+        uint32_t length = sauGetU32(record);
+        uint64_t source = sauGetU64(record + 4);
+        if (length == 0 || length > DEDUP_MAX_CHUNK || length > size - extracted) {
+            errno = EIO;
+            return -1;
+        }
+        if (source == 0) {
+            if (chunks->count == chunks->capacity) {
+                uint64_t capacity = chunks->capacity ? 2 * chunks->capacity : 1024;
+                StreamChunk *grown = realloc(chunks->chunks, capacity * sizeof(StreamChunk));
+                if (!grown) {
+                    return -1;
+                }
+                chunks->chunks = grown;
+                chunks->capacity = capacity;
+            }
+            StreamChunk *added = &chunks->chunks[chunks->count];
+            added->archiveOffset = stream->position;
+            added->spillOffset = chunks->spillLength;
+            added->length = length;
+            if (readArchiveStream(stream, chunk, length) == -1 ||
+                pwrite(chunks->spillFd, chunk, length, added->spillOffset) != (ssize_t)length) {
+                return -1;
+            }
+            chunks->spillLength += length;
+            chunks->count++;
+        } else {
+            const StreamChunk *stored = findStreamChunk(chunks, source);
+            if (!stored || stored->length != length) {
+                errno = EIO;  // References only ever point at earlier new chunks
+                return -1;
+            }
+            if (pread(chunks->spillFd, chunk, length, stored->spillOffset) != (ssize_t)length) {
+                return -1;
+            }
+        }
+        if (writeFully(outputFd, chunk, length) == -1) {
+            return -1;
+        }
+        extracted += length;
+    }
+    return 0;
+}
+
+// Extracts the data of one member record as it arrives, extent by extent
+// for a sparse member, whose holes are left unwritten
+static int extractStreamMember(ArchiveStream *stream, uint32_t flags, uint64_t size, int outputFd,
+                               StreamChunks *chunks) {
+    MemberExtents map;
+    denseExtents(&map, size);
+    if (flags & SAU_MEMBER_SPARSE) {
+        unsigned char countField[SAU_EXTENT_COUNT_SIZE];
+        if (readArchiveStream(stream, countField, sizeof(countField)) == -1) {
+            return -1;
+        }
+        uint64_t count = sauGetU64(countField);
+        // Extents are disjoint and never empty; the cap also keeps the map
+        // size below from overflowing
+        if (count > size || count > SAU_MAX_EXTENTS) {
+            errno = EIO;
+            return -1;
+        }
+        unsigned char *encoded = malloc(count * SAU_EXTENT_SIZE + 1);
+        if (!encoded) {
+            return -1;
+        }
+        int result = readArchiveStream(stream, encoded, count * SAU_EXTENT_SIZE);
+        if (result == 0) {
+            result = decodeExtents(&map, encoded, count, size);
+        }
+        free(encoded);
+        if (result == -1) {
+            return -1;
+        }
+    }
+
+    int result = 0;
+    for (uint64_t i = 0; i < map.count && result == 0; i++) {
+        uint64_t length = map.extents[i].length;
+        result = seekExtent(outputFd, &map, i);
+        if (result == -1) {
+            break;
+        }
+        if (flags & SAU_MEMBER_DEDUP) {
+            result = extractStreamChunks(stream, length, outputFd, chunks);
+        } else if (flags & SAU_MEMBER_COMPRESSED) {
+            result = extractStreamBlocks(stream, length, outputFd);
+        } else {
+            result = copyArchiveStream(stream, outputFd, length);
+        }
+    }
+    if (result == 0 && (flags & SAU_MEMBER_SPARSE)) {
+        result = ftruncate(outputFd, size);
+    }
+    freeExtents(&map);
+    return result;
+}
+
+// Extracts a version 1 archive from the stream: its text header lists the
+// members in the order their data follows. The 4 bytes already read are the
+// start of the header line.
+static void extractLegacyStream(ArchiveStream *stream, const char *magic, DirCache *tree) {
+    ArchiveToc toc = {0};
+    LegacyParser parser;
+    LegacyTocBuilder builder = {&toc, 0, 0, 0, 0};
+
+    // The header is parsed straight out of the stream buffer
+    legacyParserInit(&parser);
+    ssize_t consumed = legacyParse(&parser, magic, SAU_MAGIC_SIZE, addLegacyEntry, &builder);
+    while (consumed != -1 && !parser.done) {
+        if (fillArchiveStream(stream) <= 0) {
+            consumed = -1;
+            break;
+        }
+        consumed = legacyParse(&parser, stream->buffer + stream->start, stream->end - stream->start, addLegacyEntry,
+                               &builder);
+        if (consumed != -1) {
+            stream->start += consumed;
+            stream->position += consumed;
+        }
+    }
+    if (consumed == -1) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        exit(EXIT_FAILURE);
+    }
+    finishLegacyToc(&builder, parser.length);
+
+    for (uint64_t i = 0; i < toc.count; i++) {
+        const SauTocEntry *entry = &toc.entries[i];
+        const char *filePath = toc.names + entry->nameOffset;
+        int outputFd = createMemberFile(tree, filePath, entry->mode, entry->size, 0);
+        if (outputFd == -1) {
+            handleFileError("creating file", filePath);
+        }
+        if (copyArchiveStream(stream, outputFd, entry->size) == -1) {
+            handleFileError("extracting", filePath);
+        }
+        close(outputFd);
+        printf("%s,", filePath);
+    }
+    freeArchiveToc(&toc);
+}
+
+// Consumes the TOC, names blob and index that follow a TOC magic, through
+// the trailer that points back at tocOffset and ends right after the index.
+// Returns -1 (errno EIO if the stream ended first) if there is none.
+static int skipStreamToc(ArchiveStream *stream, uint64_t tocOffset, SauTrailer *trailer) {
+    // The last bytes of the previous read are kept in front of the next one,
+    // so a trailer split between two reads is still seen whole
+    unsigned char *window = malloc(SAU_TRAILER_SIZE + STREAM_BUFFER_SIZE);
+    if (!window) {
+        return -1;
+    }
+    size_t kept = 0;
+    for (;;) {
+        ssize_t available = fillArchiveStream(stream);
+        if (available <= 0) {
+            free(window);
+            if (available == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        memcpy(window + kept, stream->buffer + stream->start, available);
+        size_t length = kept + available;
+        uint64_t windowOffset = stream->position - kept;
+        for (size_t candidate = 0; candidate + SAU_TRAILER_SIZE <= length; candidate++) {
+            if (window[candidate + 48] == SAU_TRAILER_MAGIC[0] && sauDecodeTrailer(window + candidate, trailer) == 0 &&
+                trailer->tocOffset == tocOffset && sauCheckTrailer(trailer, windowOffset + candidate) == 0) {
+                size_t consumed = candidate + SAU_TRAILER_SIZE - kept;
+                stream->start += consumed;
+                stream->position += consumed;
+                free(window);
+                return 0;
+            }
+        }
+        stream->start = stream->end;
+        stream->position += available;
+        kept = length < SAU_TRAILER_SIZE - 1 ? length : SAU_TRAILER_SIZE - 1;
+        memmove(window, window + length - kept, kept);
+    }
+}
+
+// Extracts an archive read front to back from archiveFd, normally a pipe,
+// in one pass: members are recreated from their inline records as they
+// arrive, so nothing is seeked or reread. A version 2 TOC is only checked
+// to reach its trailer; records that follow it were appended by an update.
+void extractStream(int archiveFd, const char *extractDirectory) {
+    ArchiveStream stream = {archiveFd, malloc(STREAM_BUFFER_SIZE), 0, 0, 0, true};
+    StreamChunks chunks = {-1, -1, 0, NULL, 0, 0};
+    if (!stream.buffer) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(archiveFd, F_SETPIPE_SZ, STREAM_BUFFER_SIZE);  // Fails harmlessly on files and over the limit
+    DirCache *tree = openExtractDirectory(extractDirectory);
+    chunks.directoryFd = dirCacheFd(tree);
+
+    statsPhase("extract members");
+    unsigned char header[SAU_FILE_HEADER_SIZE];
+    if (readArchiveStream(&stream, header, SAU_MAGIC_SIZE) == -1) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (memcmp(header, SAU_FILE_MAGIC, SAU_MAGIC_SIZE) != 0) {
+        extractLegacyStream(&stream, (const char *)header, tree);
+    } else {
+        if (readArchiveStream(&stream, header + SAU_MAGIC_SIZE, SAU_FILE_HEADER_SIZE - SAU_MAGIC_SIZE) == -1 ||
+            sauGetU32(header + 4) != SAU_VERSION) {
+            printf("Archive file is inappropriate or corrupt!\n");
+            exit(EXIT_FAILURE);
+        }
+
+        unsigned char record[SAU_RECORD_HEADER_SIZE];
+        uint64_t numRecords = 0;
+        for (;;) {
+            if (readArchiveStream(&stream, record, SAU_MAGIC_SIZE) == -1) {
+                printf("Archive file is inappropriate or corrupt!\n");
+                exit(EXIT_FAILURE);
+            }
+            if (memcmp(record, SAU_TOC_MAGIC, SAU_MAGIC_SIZE) == 0) {
+                SauTrailer trailer;
+                if (skipStreamToc(&stream, stream.position - SAU_MAGIC_SIZE, &trailer) == -1 ||
+                    trailer.entryCount > numRecords) {
+                    printf("Archive file is inappropriate or corrupt!\n");
+                    exit(EXIT_FAILURE);
+                }
+                ssize_t available = fillArchiveStream(&stream);
+                if (available == -1) {
+                    printf("Archive file is inappropriate or corrupt!\n");
+                    exit(EXIT_FAILURE);
+                }
+                if (available == 0) {
+                    break;  // The last trailer ends the stream
+                }
+                continue;  // An update (-u) appended more members after it
+            }
+            char filePath[PATH_MAX];
+            uint32_t nameLength = 0;
+            if (memcmp(record, SAU_RECORD_MAGIC, SAU_MAGIC_SIZE) != 0 ||
+                readArchiveStream(&stream, record + SAU_MAGIC_SIZE, SAU_RECORD_HEADER_SIZE - SAU_MAGIC_SIZE) == -1 ||
+                (nameLength = sauGetU32(record + 4)) == 0 || nameLength >= sizeof(filePath) ||
+                readArchiveStream(&stream, filePath, nameLength) == -1) {
+                printf("Archive file is inappropriate or corrupt!\n");
+                exit(EXIT_FAILURE);
+            }
+            filePath[nameLength] = '\0';
+            uint32_t mode = sauGetU32(record + 8);
+            uint32_t flags = sauGetU32(record + 12);
+            uint64_t size = sauGetU64(record + 16);
+
+            // A member updated with -u appears twice; the later record
+            // overwrites the file, as its TOC entry would
+            int outputFd = createMemberFile(tree, filePath, mode, size, flags);
+            if (outputFd == -1) {
+                handleFileError("creating file", filePath);
+            }
+            if (extractStreamMember(&stream, flags, size, outputFd, &chunks) == -1) {
+                handleFileError("extracting", filePath);
+            }
+            close(outputFd);
+            printf("%s,", filePath);
+            numRecords++;
+        }
+    }
 
+    if (chunks.spillFd != -1) {
+        close(chunks.spillFd);
+    }
+    free(chunks.chunks);
+    free(stream.buffer);
+    dirCacheClose(tree);
     printf("files opened in the %s directory.\n", extractDirectory);
 }
 
+// Extracts the named members into the current directory. Version 2 archives
+// are searched through their name index, so only the trailer, the probed
+// index slots and the requested members are read; the volumes of a split
+// archive are searched in turn, each through its own index. Version 1
+// archives have no index and fall back to a scan of the text header.
+void extractSelectedMembers(const char *archiveFileName, char **names, int numNames) {
+    uint64_t numVolumes = countVolumes(archiveFileName);
+    uint64_t numArchives = numVolumes > 0 ? numVolumes : 1;
+    FILE **archiveFiles = malloc(numArchives * sizeof(FILE *));
+    SauTrailer *trailers = malloc(numArchives * sizeof(SauTrailer));
+    if (!archiveFiles || !trailers) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+
+    bool isLegacy = false;
+    ArchiveToc toc = {0};
+    statsPhase("read toc");
+    for (uint64_t volume = 0; volume < numArchives; volume++) {
+        char name[PATH_MAX];
+        if (numVolumes > 0) {
+            volumeName(name, sizeof(name), archiveFileName, volume + 1);
+        }
+        const char *fileName = numVolumes > 0 ? name : archiveFileName;
+        archiveFiles[volume] = fopen(fileName, "rb");
+        statsAdd(STATS_OPEN_CALLS, 1);
+        if (!archiveFiles[volume]) {
+            handleFileError("opening archive file", fileName);
+        }
+
+        int archiveFd = fileno(archiveFiles[volume]);
+        char magic[SAU_MAGIC_SIZE];
+        if (pread(archiveFd, magic, sizeof(magic), 0) == sizeof(magic) &&
+            memcmp(magic, SAU_FILE_MAGIC, SAU_MAGIC_SIZE) == 0) {
+            if (readArchiveTrailer(archiveFd, &trailers[volume]) == -1) {
+                printf("Archive file is inappropriate or corrupt!\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (numVolumes > 0 || loadArchiveToc(archiveFiles[volume], &toc, &isLegacy) == -1) {
+            // Volumes are always version 2
+            printf("Archive file is inappropriate or corrupt!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    DirCache *tree = openExtractDirectory(".");
+    statsPhase("extract members");
+    int missing = 0;
+    for (int n = 0; n < numNames; n++) {
+        SauTocEntry entry;
+        int found = 0;
+        int archiveFd = fileno(archiveFiles[0]);
+        if (!isLegacy) {
+            for (uint64_t volume = 0; volume < numArchives && !found; volume++) {
+                archiveFd = fileno(archiveFiles[volume]);
+                found = findArchiveMember(archiveFd, &trailers[volume], names[n], &entry);
+                if (found == -1) {
+                    handleFileError("reading archive", archiveFileName);
+                }
+            }
+        } else {
+            for (uint64_t i = 0; i < toc.count && !found; i++) {
+                if (strcmp(toc.names + toc.entries[i].nameOffset, names[n]) == 0) {
+                    entry = toc.entries[i];
+                    found = 1;
+                }
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "%s: not found in archive\n", names[n]);
+            missing++;
+            continue;
+        }
+
+        int outputFd = createMemberFile(tree, names[n], entry.mode, entry.size, entry.flags);
+        if (outputFd == -1) {
+            handleFileError("creating file", names[n]);
+        }
+        if (extractMember(archiveFd, &entry, outputFd, 1) == -1) {
+            handleFileError("extracting", names[n]);
+        }
+        close(outputFd);
+        printf("%s,", names[n]);
+    }
+
+    freeArchiveToc(&toc);
+    for (uint64_t volume = 0; volume < numArchives; volume++) {
+        fclose(archiveFiles[volume]);
+    }
+    free(archiveFiles);
+    free(trailers);
+    dirCacheClose(tree);
+
+    printf("files extracted.\n");
+    if (missing > 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+typedef struct {
+    const unsigned char *archive;  // Member data area, mapped read-only
+    uint64_t dataEnd;              // Size of the mapping: the TOC offset
+    const ArchiveToc *toc;
+    atomic_uint_fast64_t corrupt;
+    atomic_uint_fast64_t unchecked;
+} VerifyJob;
+
+// Computes the CRC-32C of a member's extracted content straight from the
+// mapped archive, decoding blocks and following chunk references the way
+// extraction does. For a sparse member that is the content of its extents.
+// Returns -1 if the member data is malformed.
+static int memberChecksum(const VerifyJob *job, const SauTocEntry *entry, uint32_t *checksum) {
+    static __thread char raw[COPY_BUFFER_SIZE];
+    const unsigned char *archive = job->archive;
+    uint64_t end = entry->offset + entry->storedSize;
+    uint64_t checked = 0;
+    uint32_t crc = 0;
+
+    MemberExtents map;
+    denseExtents(&map, entry->size);
+    if (entry->flags & SAU_MEMBER_SPARSE) {
+        if (entry->storedSize < SAU_EXTENT_COUNT_SIZE) {
+            return -1;
+        }
+        uint64_t count = sauGetU64(archive + entry->offset);
+        if (count > (entry->storedSize - SAU_EXTENT_COUNT_SIZE) / SAU_EXTENT_SIZE ||
+            decodeExtents(&map, archive + entry->offset + SAU_EXTENT_COUNT_SIZE, count, entry->size) == -1) {
+            return -1;
+        }
+    }
+    uint64_t position = entry->offset + map.mapSize;
+    uint64_t dataSize = map.dataSize;
+    uint64_t extentIndex = 0;
+    uint64_t extentEnd = 0;  // Checked bytes up to the end of the current extent
+
+    if (!(entry->flags & (SAU_MEMBER_COMPRESSED | SAU_MEMBER_DEDUP))) {
+        freeExtents(&map);
+        if (map.mapSize + dataSize != entry->storedSize) {
+            return -1;
+        }
+        uint64_t checksumStart = statsClock();
+        *checksum = crc32c(0, archive + position, dataSize);
+        statsAddTime(STATS_CHECKSUM_NS, checksumStart);
+        return 0;
+    }
+
+    while (checked < dataSize) {
+        if (checked == extentEnd) {
+            extentEnd += map.extents[extentIndex++].length;
+        }
+        const void *data;
+        uint32_t length;
+        if (entry->flags & SAU_MEMBER_DEDUP) {
+            if (end - position < SAU_CHUNK_HEADER_SIZE) {
+                break;
+            }
+            length = sauGetU32(archive + position);
+            uint64_t source = sauGetU64(archive + position + 4);
+            position += SAU_CHUNK_HEADER_SIZE;
+            if (length == 0 || length > DEDUP_MAX_CHUNK || length > extentEnd - checked) {
+                break;
+            }
+            if (source == 0) {
+                if (length > end - position) {
+                    break;
+                }
+                source = position;
+                position += length;
+            } else if (source < SAU_FILE_HEADER_SIZE || source >= position || length > job->dataEnd - source) {
+                break;
+            }
+            data = archive + source;
+        } else {
+            if (end - position < SAU_BLOCK_HEADER_SIZE) {
+                break;
+            }
+            length = sauGetU32(archive + position);
+            uint32_t storedLength = sauGetU32(archive + position + 4);
+            position += SAU_BLOCK_HEADER_SIZE;
+            if (length == 0 || length > COPY_BUFFER_SIZE || storedLength > length ||
+                storedLength > end - position || length > extentEnd - checked) {
+                break;
+            }
+            data = archive + position;
+            if (storedLength < length) {
+                uint64_t decompressStart = statsClock();
+                int result = lzDecompress(archive + position, storedLength, raw, length);
+                statsAddTime(STATS_DECOMPRESS_NS, decompressStart);
+                if (result == -1) {
+                    freeExtents(&map);
+                    return -1;
+                }
+                data = raw;
+            }
+            position += storedLength;
+        }
+        uint64_t checksumStart = statsClock();
+        crc = crc32c(crc, data, length);
+        statsAddTime(STATS_CHECKSUM_NS, checksumStart);
+        checked += length;
+    }
+
+    freeExtents(&map);
+    if (checked != dataSize || position != end) {
+        return -1;
+    }
+    *checksum = crc;
+    return 0;
+}
+
+static void verifyMemberTask(uint64_t memberIndex, void *context) {
+    VerifyJob *job = context;
+    const SauTocEntry *entry = &job->toc->entries[memberIndex];
+    const char *name = job->toc->names + entry->nameOffset;
+    uint32_t checksum;
+
+    if (memberChecksum(job, entry, &checksum) == -1) {
+        fprintf(stderr, "%s: malformed member data\n", name);
+        atomic_fetch_add(&job->corrupt, 1);
+    } else if (!(entry->flags & SAU_MEMBER_CHECKSUM)) {
+        atomic_fetch_add(&job->unchecked, 1);
+    } else if (checksum != entry->checksum) {
+        fprintf(stderr, "%s: checksum mismatch (stored %08x, computed %08x)\n", name,
+                (unsigned)entry->checksum, (unsigned)checksum);
+        atomic_fetch_add(&job->corrupt, 1);
+    }
+}
+
+// Checks every member of a version 2 archive against its stored CRC-32C on
+// up to numThreads threads, without writing any files. The member data is
+// mapped rather than read, so plain members are checksummed in place in the
+// page cache and only compressed blocks are copied (by decoding them).
+// Exits with failure if any member is corrupt.
+void verifyArchive(const char *archiveFileName, int numThreads) {
+    FILE *archiveFile = fopen(archiveFileName, "rb");
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (!archiveFile) {
+        handleFileError("opening archive file", archiveFileName);
+    }
+    int archiveFd = fileno(archiveFile);
+
+    ArchiveToc toc;
+    SauTrailer trailer;
+    bool isLegacy;
+    statsPhase("read toc");
+    if (loadArchiveToc(archiveFile, &toc, &isLegacy) == -1 ||
+        (!isLegacy && readArchiveTrailer(archiveFd, &trailer) == -1)) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (isLegacy) {
+        printf("Version 1 archives carry no checksums; rebuild them without --v1.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    statsPhase("verify");
+    void *archive = mmap(NULL, trailer.tocOffset, PROT_READ, MAP_SHARED, archiveFd, 0);
+    if (archive == MAP_FAILED) {
+        handleFileError("mapping archive", archiveFileName);
+    }
+    madvise(archive, trailer.tocOffset, MADV_SEQUENTIAL);
+
+    VerifyJob job = {archive, trailer.tocOffset, &toc, 0, 0};
+    runParallel(numThreads, toc.count, verifyMemberTask, &job);
+    munmap(archive, trailer.tocOffset);
+
+    uint64_t corrupt = atomic_load(&job.corrupt);
+    uint64_t unchecked = atomic_load(&job.unchecked);
+    printf("%llu members verified, %llu without checksum, %llu corrupt.\n",
+           (unsigned long long)(toc.count - corrupt - unchecked), (unsigned long long)unchecked,
+           (unsigned long long)corrupt);
+    freeArchiveToc(&toc);
+    fclose(archiveFile);
+    if (corrupt > 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Prints the permissions, extracted size, stored size and name of every member
+void listArchive(const char *archiveFileName) {
+    FILE *archiveFile = fopen(archiveFileName, "rb");
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (!archiveFile) {
+        handleFileError("opening archive file", archiveFileName);
+    }
+
+    ArchiveToc toc;
+    statsPhase("read toc");
+    if (loadArchiveToc(archiveFile, &toc, NULL) == -1) {
+        printf("Archive file is inappropriate or corrupt!\n");
+        fclose(archiveFile);
+        exit(EXIT_FAILURE);
+    }
+
+    statsPhase("list");
+    for (uint64_t i = 0; i < toc.count; i++) {
+        const SauTocEntry *entry = &toc.entries[i];
+        printf("%04o %12llu %12llu %s\n", (unsigned)entry->mode, (unsigned long long)entry->size,
+               (unsigned long long)entry->storedSize, toc.names + entry->nameOffset);
+    }
+
+    freeArchiveToc(&toc);
+    fclose(archiveFile);
+}
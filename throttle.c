@@ -0,0 +1,148 @@
+#include "throttle.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define THROTTLE_BURST_NS 100000000ULL
+#define THROTTLE_MIN_CHUNK 4096
+#define PROGRESS_INTERVAL_NS 1000000000ULL
+
+// From linux/ioprio.h, which older headers do not ship
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// A bucket is kept as the time at which it would be full again: each
+// request moves that time on by its cost, and has to wait until it is no
+// more than one burst ahead of the clock
+typedef struct {
+    double nsPerUnit;  // 0 when unlimited
+    uint64_t fullAt;
+} Bucket;
+
+bool throttleEnabled;
+
+static pthread_mutex_t bucketLock = PTHREAD_MUTEX_INITIALIZER;
+static Bucket byteBucket;
+static Bucket opBucket;
+static uint64_t chunkLimit = UINT64_MAX;
+
+static _Atomic uint64_t movedBytes;
+static _Atomic uint64_t movedOps;
+static uint64_t progressStart;
+static bool progressTerminal;
+
+static uint64_t clockNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void throttleSetLimits(double bytesPerSecond, double opsPerSecond) {
+    byteBucket.nsPerUnit = bytesPerSecond > 0 ? 1e9 / bytesPerSecond : 0;
+    opBucket.nsPerUnit = opsPerSecond > 0 ? 1e9 / opsPerSecond : 0;
+    if (bytesPerSecond > 0) {
+        double burst = bytesPerSecond * THROTTLE_BURST_NS / 1e9;
+        chunkLimit = burst > THROTTLE_MIN_CHUNK ? (uint64_t)burst : THROTTLE_MIN_CHUNK;
+    }
+    if (bytesPerSecond > 0 || opsPerSecond > 0) {
+        throttleEnabled = true;
+    }
+}
+
+// Takes amount units from bucket and returns the time the caller may go on
+static uint64_t takeTokens(Bucket *bucket, uint64_t amount, uint64_t now) {
+    if (bucket->nsPerUnit == 0 || amount == 0) {
+        return now;
+    }
+    if (bucket->fullAt < now) {
+        bucket->fullAt = now;
+    }
+    bucket->fullAt += (uint64_t)(amount * bucket->nsPerUnit);
+    return bucket->fullAt > now + THROTTLE_BURST_NS ? bucket->fullAt - THROTTLE_BURST_NS : now;
+}
+
+void throttleWait(uint64_t bytes, uint64_t ops) {
+    atomic_fetch_add_explicit(&movedBytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&movedOps, ops, memory_order_relaxed);
+    if (byteBucket.nsPerUnit == 0 && opBucket.nsPerUnit == 0) {
+        return;
+    }
+
+    uint64_t now = clockNs();
+    pthread_mutex_lock(&bucketLock);
+    uint64_t byteTime = takeTokens(&byteBucket, bytes, now);
+    uint64_t opTime = takeTokens(&opBucket, ops, now);
+    pthread_mutex_unlock(&bucketLock);
+
+    uint64_t until = byteTime > opTime ? byteTime : opTime;
+    if (until > now) {
+        struct timespec deadline = {until / 1000000000, until % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+    }
+}
+
+uint64_t throttleChunk(uint64_t size) {
+    return size < chunkLimit ? size : chunkLimit;
+}
+
+// Prints the total moved and the rates over the given seconds
+static void printProgress(uint64_t bytes, uint64_t intervalBytes, uint64_t intervalOps, double seconds,
+                          const char *suffix) {
+    fprintf(stderr, "%s%.1f MB, %.1f MB/s, %.0f IOPS%s", progressTerminal ? "\r" : "", bytes / (1024.0 * 1024),
+            seconds > 0 ? intervalBytes / seconds / (1024 * 1024) : 0.0, seconds > 0 ? intervalOps / seconds : 0.0,
+            suffix);
+    fflush(stderr);
+}
+
+static void *progressThread(void *unused) {
+    (void)unused;
+    uint64_t lastTime = progressStart;
+    uint64_t lastBytes = 0;
+    uint64_t lastOps = 0;
+    for (;;) {
+        uint64_t wake = lastTime + PROGRESS_INTERVAL_NS;
+        struct timespec deadline = {wake / 1000000000, wake % 1000000000};
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0) {
+            continue;
+        }
+        uint64_t now = clockNs();
+        uint64_t bytes = atomic_load_explicit(&movedBytes, memory_order_relaxed);
+        uint64_t ops = atomic_load_explicit(&movedOps, memory_order_relaxed);
+        // A terminal line is rewritten in place, so pad over a longer one
+        printProgress(bytes, bytes - lastBytes, ops - lastOps, (now - lastTime) / 1e9,
+                      progressTerminal ? "   " : "\n");
+        lastTime = now;
+        lastBytes = bytes;
+        lastOps = ops;
+    }
+    return NULL;
+}
+
+// Ends the progress output with the averages over the whole run
+static void finishProgress(void) {
+    uint64_t bytes = atomic_load(&movedBytes);
+    printProgress(bytes, bytes, atomic_load(&movedOps), (clockNs() - progressStart) / 1e9, " on average\n");
+}
+
+void throttleStartProgress(void) {
+    throttleEnabled = true;
+    progressTerminal = isatty(STDERR_FILENO);
+    progressStart = clockNs();
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, progressThread, NULL) == 0) {
+        pthread_detach(thread);
+        atexit(finishProgress);
+    }
+}
+
+int throttleIdlePriority(void) {
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+}
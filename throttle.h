@@ -0,0 +1,42 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Limits on the data I/O of a run, for hosts where tarsau shares its disks
+// with other work. --rate-limit caps the bytes read and written per second
+// and --iops-limit the read and write requests; each is a token bucket that
+// holds 100 ms of work, so a short pause is made up but the average never
+// goes over the limit. Threads take their tokens from the same buckets.
+
+extern bool throttleEnabled;  // A limit is set or progress is shown
+
+// A limit of 0 leaves that side unlimited
+void throttleSetLimits(double bytesPerSecond, double opsPerSecond);
+
+// Prints the bytes moved so far and the current throughput on stderr once
+// a second, and a summary line at exit
+void throttleStartProgress(void);
+
+// Moves the process into the idle I/O class, whose requests the block
+// layer only serves while no other process has any pending. Must be called
+// before any thread is started, as threads inherit it. Returns -1 with
+// errno set on failure.
+int throttleIdlePriority(void);
+
+void throttleWait(uint64_t bytes, uint64_t ops);
+
+// Accounts ops read or write requests moving bytes in total, sleeping first
+// as long as the limits require
+static inline void throttleIo(uint64_t bytes, uint64_t ops) {
+    if (throttleEnabled) {
+        throttleWait(bytes, ops);
+    }
+}
+
+// Size of the next request out of size bytes: capped to one burst of the
+// rate limit, so a large copy waits in small steps rather than once
+uint64_t throttleChunk(uint64_t size);
+
+#endif
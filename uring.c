@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include "uring.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define URING_LINUX 1
+#endif
+#endif
+#endif
+
+#ifdef URING_LINUX
+struct Uring {
+    int fd;
+    void *rings;  // Submission and completion rings, one mapping
+    size_t ringsSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqTail;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned tail;    // Local copy of the submission tail
+    unsigned queued;  // Operations queued since the last uringRun
+    struct io_uring_sqe *last;
+};
+
+// The operations the wrappers below use
+static const int requiredOps[] = {
+    IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE,
+};
+
+static bool supportsRequiredOps(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (!probe) {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; supported && i < sizeof(requiredOps) / sizeof(requiredOps[0]); i++) {
+        int op = requiredOps[i];
+        supported = op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+Uring *uringCreate(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd == -1) {
+        return NULL;
+    }
+    // Kernels without a single ring mapping (before 5.4) also lack the
+    // operations tarsau needs
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !supportsRequiredOps(fd)) {
+        close(fd);
+        return NULL;
+    }
+
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->rings = mmap(NULL, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->rings != MAP_FAILED) {
+            munmap(ring->rings, ring->ringsSize);
+        }
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqesSize);
+        }
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    char *rings = ring->rings;
+    ring->sqTail = (unsigned *)(rings + params.sq_off.tail);
+    ring->sqArray = (unsigned *)(rings + params.sq_off.array);
+    ring->sqMask = *(unsigned *)(rings + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->cqHead = (unsigned *)(rings + params.cq_off.head);
+    ring->cqTail = (unsigned *)(rings + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+    ring->tail = *ring->sqTail;
+    return ring;
+}
+
+void uringDestroy(Uring *ring) {
+    if (!ring) {
+        return;
+    }
+    munmap(ring->sqes, ring->sqesSize);
+    munmap(ring->rings, ring->ringsSize);
+    close(ring->fd);
+    free(ring);
+}
+
+unsigned uringSpace(const Uring *ring) {
+    return ring->sqEntries - ring->queued;
+}
+
+// Claims the next submission entry, zeroed; callers check uringSpace first
+static struct io_uring_sqe *queueOp(Uring *ring, int op, int fd, const void *address, unsigned length,
+                                    uint64_t offset, int *result) {
+    unsigned index = ring->tail & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)address;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)(uintptr_t)result;
+    ring->sqArray[index] = index;
+    ring->tail++;
+    ring->queued++;
+    ring->last = sqe;
+    return sqe;
+}
+
+void uringOpenat(Uring *ring, int dirFd, const char *path, int flags, mode_t mode, int *result) {
+    struct io_uring_sqe *sqe = queueOp(ring, IORING_OP_OPENAT, dirFd, path, mode, 0, result);
+    sqe->open_flags = flags;
+}
+
+void uringStatx(Uring *ring, int dirFd, const char *path, int flags, unsigned mask, struct statx *buffer,
+                int *result) {
+    struct io_uring_sqe *sqe = queueOp(ring, IORING_OP_STATX, dirFd, path, mask, (uint64_t)(uintptr_t)buffer, result);
+    sqe->statx_flags = flags;
+}
+
+void uringRead(Uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, int *result) {
+    queueOp(ring, IORING_OP_READ, fd, buffer, length, offset, result);
+}
+
+void uringWrite(Uring *ring, int fd, const void *buffer, unsigned length, uint64_t offset, int *result) {
+    queueOp(ring, IORING_OP_WRITE, fd, buffer, length, offset, result);
+}
+
+void uringClose(Uring *ring, int fd, int *result) {
+    queueOp(ring, IORING_OP_CLOSE, fd, NULL, 0, 0, result);
+}
+
+
+int uringRun(Uring *ring) {
+    unsigned toSubmit = ring->queued;
+    unsigned pending = ring->queued;
+    __atomic_store_n(ring->sqTail, ring->tail, __ATOMIC_RELEASE);
+
+    while (pending > 0) {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, toSubmit, pending, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return -1;
+        }
+        if (submitted > 0) {
+            toSubmit -= submitted;
+        }
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+            *(int *)(uintptr_t)cqe->user_data = cqe->res;
+            pending--;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    ring->queued = 0;
+    ring->last = NULL;
+    return 0;
+}
+#else
+Uring *uringCreate(unsigned entries) {
+    return NULL;
+}
+
+void uringDestroy(Uring *ring) {
+}
+
+unsigned uringSpace(const Uring *ring) {
+    return 0;
+}
+
+void uringOpenat(Uring *ring, int dirFd, const char *path, int flags, mode_t mode, int *result) {
+}
+
+void uringStatx(Uring *ring, int dirFd, const char *path, int flags, unsigned mask, struct statx *buffer,
+                int *result) {
+}
+
+void uringRead(Uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, int *result) {
+}
+
+void uringWrite(Uring *ring, int fd, const void *buffer, unsigned length, uint64_t offset, int *result) {
+}
+
+void uringClose(Uring *ring, int fd, int *result) {
+}
+
+
+int uringRun(Uring *ring) {
+    errno = ENOSYS;
+    return -1;
+}
+#endif
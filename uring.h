@@ -0,0 +1,38 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct statx;
+
+// A minimal io_uring driver made of raw syscalls, so tarsau needs neither
+// liburing nor a kernel that has io_uring. Operations are queued, then
+// uringRun submits them all with one io_uring_enter call and waits for
+// every completion. Each operation stores the result of the syscall it
+// stands for in *result: the return value, or -errno on failure.
+// A ring is used by one thread at a time.
+typedef struct Uring Uring;
+
+// Returns NULL if io_uring cannot be used: built without it, a kernel that
+// lacks it or one of the operations below, or io_uring disabled by sysctl
+// or seccomp. Callers then take their blocking path.
+Uring *uringCreate(unsigned entries);
+
+void uringDestroy(Uring *ring);
+
+// Number of operations that can still be queued before uringRun
+unsigned uringSpace(const Uring *ring);
+
+void uringOpenat(Uring *ring, int dirFd, const char *path, int flags, mode_t mode, int *result);
+void uringStatx(Uring *ring, int dirFd, const char *path, int flags, unsigned mask, struct statx *buffer,
+                int *result);
+void uringRead(Uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, int *result);
+void uringWrite(Uring *ring, int fd, const void *buffer, unsigned length, uint64_t offset, int *result);
+void uringClose(Uring *ring, int fd, int *result);
+
+// Submits every queued operation and waits for all of them. Returns -1
+// with errno set if io_uring_enter itself fails.
+int uringRun(Uring *ring);
+
+#endif
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include "walk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "stats.h"
+
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+
+// Record layout returned by getdents64
+typedef struct {
+    uint64_t inode;
+    int64_t offset;
+    unsigned short recordLength;
+    unsigned char type;
+    char name[];
+} LinuxDirent64;
+
+typedef struct {
+    char path[PATH_MAX];  // Directory being walked, ending in '/'
+    MemberList *inputs;
+    bool statFiles;
+} Walker;
+
+// Subdirectory names of one directory, each NUL-terminated
+typedef struct {
+    char *names;
+    size_t length;
+    size_t capacity;
+    int count;
+} NameList;
+
+typedef struct {
+    int rootFd;
+    const char *rootPath;
+    size_t rootLength;
+    NameList *subdirs;
+    size_t *nameOffsets;
+    MemberList *results;  // One list per subdirectory
+    bool statFiles;
+} SubtreeJob;
+
+static void reportEntry(const Walker *walker, size_t pathLength, const char *name, int error) {
+    fprintf(stderr, "Error reading %.*s%s: %s\n", (int)pathLength, walker->path, name, strerror(error));
+}
+
+static void addName(NameList *list, const char *name) {
+    size_t length = strlen(name) + 1;
+    if (list->length + length > list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 1024;
+        while (list->length + length > list->capacity) {
+            list->capacity *= 2;
+        }
+        list->names = realloc(list->names, list->capacity);
+        if (!list->names) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(list->names + list->length, name, length);
+    list->length += length;
+    list->count++;
+}
+
+// Adds the regular files of the directory open as dirFd and collects its
+// subdirectories; walker->path holds the directory's path (pathLength bytes)
+static void listDirectory(Walker *walker, int dirFd, size_t pathLength, NameList *subdirs) {
+    static __thread char buffer[DIRENT_BUFFER_SIZE];
+
+    for (;;) {
+        long length = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        statsAdd(STATS_GETDENTS_CALLS, 1);
+        if (length == -1) {
+            reportEntry(walker, pathLength, "", errno);
+            return;
+        }
+        if (length == 0) {
+            return;
+        }
+
+        for (long position = 0; position < length; ) {
+            LinuxDirent64 *entry = (LinuxDirent64 *)(buffer + position);
+            position += entry->recordLength;
+            const char *name = entry->name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+
+            unsigned char type = entry->type;
+            struct stat st;
+            bool statDone = false;
+            if (type == DT_UNKNOWN || (type == DT_REG && walker->statFiles)) {
+                statsAdd(STATS_STAT_CALLS, 1);
+                if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                    reportEntry(walker, pathLength, name, errno);
+                    continue;
+                }
+                statDone = true;
+                type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+            }
+
+            if (type == DT_DIR) {
+                addName(subdirs, name);
+            } else if (type == DT_REG) {
+                size_t nameLength = strlen(name);
+                if (pathLength + nameLength >= sizeof(walker->path)) {
+                    reportEntry(walker, pathLength, name, ENAMETOOLONG);
+                    continue;
+                }
+                memcpy(walker->path + pathLength, name, nameLength + 1);
+                FileInfo *member = memberListAdd(walker->inputs, walker->path, pathLength + nameLength);
+                if (!member) {
+                    perror("Memory allocation error");
+                    exit(EXIT_FAILURE);
+                }
+                if (statDone) {
+                    member->size = st.st_size;
+                    member->mode = st.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+                }
+            } else {
+                fprintf(stderr, "Skipping %.*s%s: not a regular file or directory\n", (int)pathLength,
+                        walker->path, name);
+            }
+        }
+    }
+}
+
+// Walks the directory open as dirFd (closing it) and everything below it
+static void walkTree(Walker *walker, int dirFd, size_t pathLength) {
+    NameList subdirs = {0};
+    listDirectory(walker, dirFd, pathLength, &subdirs);
+
+    const char *name = subdirs.names;
+    for (int i = 0; i < subdirs.count; i++, name += strlen(name) + 1) {
+        size_t nameLength = strlen(name);
+        if (pathLength + nameLength + 1 >= sizeof(walker->path)) {
+            reportEntry(walker, pathLength, name, ENAMETOOLONG);
+            continue;
+        }
+        int childFd = openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        statsAdd(STATS_OPEN_CALLS, 1);
+        if (childFd == -1) {
+            reportEntry(walker, pathLength, name, errno);
+            continue;
+        }
+        memcpy(walker->path + pathLength, name, nameLength);
+        walker->path[pathLength + nameLength] = '/';
+        walkTree(walker, childFd, pathLength + nameLength + 1);
+    }
+
+    free(subdirs.names);
+    close(dirFd);
+}
+
+static void walkSubtreeTask(uint64_t index, void *context) {
+    SubtreeJob *job = context;
+    const char *name = job->subdirs->names + job->nameOffsets[index];
+    Walker *walker = malloc(sizeof(Walker));
+    if (!walker) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    walker->inputs = &job->results[index];
+    walker->statFiles = job->statFiles;
+    memcpy(walker->path, job->rootPath, job->rootLength);
+
+    size_t nameLength = strlen(name);
+    if (job->rootLength + nameLength + 1 >= sizeof(walker->path)) {
+        reportEntry(walker, job->rootLength, name, ENAMETOOLONG);
+    } else {
+        int dirFd = openat(job->rootFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        statsAdd(STATS_OPEN_CALLS, 1);
+        if (dirFd == -1) {
+            reportEntry(walker, job->rootLength, name, errno);
+        } else {
+            memcpy(walker->path + job->rootLength, name, nameLength);
+            walker->path[job->rootLength + nameLength] = '/';
+            walkTree(walker, dirFd, job->rootLength + nameLength + 1);
+        }
+    }
+    free(walker);
+}
+
+int walkDirectory(const char *path, MemberList *inputs, int numThreads, bool statFiles) {
+    Walker *walker = malloc(sizeof(Walker));
+    if (!walker) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+
+    // Member names are path/..., without doubled slashes
+    size_t pathLength = strlen(path);
+    if (pathLength == 0) {
+        free(walker);
+        errno = ENOENT;
+        return -1;
+    }
+    while (pathLength > 1 && path[pathLength - 1] == '/') {
+        pathLength--;
+    }
+    if (pathLength + 1 >= sizeof(walker->path)) {
+        free(walker);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(walker->path, path, pathLength);
+    if (path[pathLength - 1] != '/') {
+        walker->path[pathLength++] = '/';
+    }
+    walker->inputs = inputs;
+    walker->statFiles = statFiles;
+
+    int rootFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    statsAdd(STATS_OPEN_CALLS, 1);
+    if (rootFd == -1) {
+        free(walker);
+        return -1;
+    }
+
+    if (numThreads <= 1) {
+        walkTree(walker, rootFd, pathLength);
+        free(walker);
+        return 0;
+    }
+
+    // The top level is listed here; its subtrees are the parallel tasks
+    NameList subdirs = {0};
+    listDirectory(walker, rootFd, pathLength, &subdirs);
+
+    SubtreeJob job = {rootFd, walker->path, pathLength, &subdirs, NULL, NULL, statFiles};
+    job.nameOffsets = malloc((subdirs.count + 1) * sizeof(size_t));
+    job.results = calloc(subdirs.count + 1, sizeof(MemberList));
+    if (!job.nameOffsets || !job.results) {
+        perror("Memory allocation error");
+        exit(EXIT_FAILURE);
+    }
+    size_t offset = 0;
+    for (int i = 0; i < subdirs.count; i++) {
+        job.nameOffsets[i] = offset;
+        offset += strlen(subdirs.names + offset) + 1;
+    }
+    runParallel(numThreads, subdirs.count, walkSubtreeTask, &job);
+
+    for (int i = 0; i < subdirs.count; i++) {
+        if (memberListAppend(inputs, &job.results[i]) == -1) {
+            perror("Memory allocation error");
+            exit(EXIT_FAILURE);
+        }
+        memberListFree(&job.results[i]);
+    }
+
+    free(job.results);
+    free(job.nameOffsets);
+    free(subdirs.names);
+    close(rootFd);
+    free(walker);
+    return 0;
+}
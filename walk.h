@@ -0,0 +1,21 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdbool.h>
+
+#include "members.h"
+
+// Adds every regular file below the directory at path to inputs, named
+// path/relative/name. Directories are read with batched getdents64 calls
+// and opened relative to their parent, so a file costs no syscall of its
+// own unless the file system does not report entry types. The order is
+// fixed: a directory's files as it lists them, then its subdirectories in
+// the same order. With numThreads > 1 the subtrees of path are walked in
+// parallel and their members joined in that same order.
+// With statFiles the size and mode of each file are filled in through
+// fstatat; otherwise they are left for whoever opens the file.
+// Entries that cannot be read are reported and skipped. Returns -1 if path
+// cannot be opened as a directory.
+int walkDirectory(const char *path, MemberList *inputs, int numThreads, bool statFiles);
+
+#endif